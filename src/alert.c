@@ -25,6 +25,7 @@
 #include <string.h>
 #include "error.h"
 #include "options.h"
+#include "timer.h"
 
 enum alert_t alert_option_parse(const char *arg)
 {
@@ -49,17 +50,18 @@ enum alert_t alert_option_parse(const char *arg)
     return alert;
 }
 
-void blink_background(void)
-{
-    // Turn on reverse video
-    printf("\e[?5h");
-    fflush(stdout);
+#define ALERT_STEP_TIME 200 // ms
 
-    usleep(200*1000);
+static int alert_timer = TIMER_INVALID;
+static int alert_steps = 0;
+static bool alert_reverse = false;
 
-    // Turn on normal video
-    printf("\e[?5l");
+static void reverse_video(bool enable)
+{
+    // Turn on reverse or normal video
+    printf(enable ? "\e[?5h" : "\e[?5l");
     fflush(stdout);
+    alert_reverse = enable;
 }
 
 void sound_bell(void)
@@ -69,6 +71,42 @@ void sound_bell(void)
     fflush(stdout);
 }
 
+/* Alerts are played step by step from timers so the main loop keeps
+ * running, a blink step toggles the video mode and a bell step rings */
+static void alert_step(void *arg)
+{
+    (void) arg;
+
+    alert_timer = TIMER_INVALID;
+
+    if (option.alert == ALERT_BLINK)
+    {
+        reverse_video(!alert_reverse);
+    }
+    else
+    {
+        sound_bell();
+    }
+
+    if (--alert_steps > 0)
+    {
+        alert_timer = timer_start(ALERT_STEP_TIME, alert_step, NULL);
+    }
+}
+
+static void alert_play(int steps)
+{
+    // Restart cleanly if previous alert is still playing
+    timer_stop(alert_timer);
+    if (alert_reverse)
+    {
+        reverse_video(false);
+    }
+
+    alert_steps = steps;
+    alert_step(NULL);
+}
+
 void alert_connect(void)
 {
     switch (option.alert)
@@ -76,10 +114,10 @@ void alert_connect(void)
         case ALERT_NONE:
             break;
         case ALERT_BELL:
-            sound_bell();
+            alert_play(1);
             break;
         case ALERT_BLINK:
-            blink_background();
+            alert_play(2);
             break;
         default:
             break;
@@ -93,14 +131,10 @@ void alert_disconnect(void)
         case ALERT_NONE:
             break;
         case ALERT_BELL:
-            sound_bell();
-            usleep(200*1000);
-            sound_bell();
+            alert_play(2);
             break;
         case ALERT_BLINK:
-            blink_background();
-            usleep(200*1000);
-            blink_background();
+            alert_play(4);
             break;
         default:
             break;
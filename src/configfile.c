@@ -41,6 +41,7 @@
 #include "print.h"
 #include "timestamp.h"
 #include "alert.h"
+#include "sequence.h"
 
 struct config_t
 {
@@ -58,6 +59,7 @@ struct config_t
     char *map;
     char *script;
     char *script_filename;
+    char *output_line_prompt;
     bool script_run;
 };
 
@@ -146,10 +148,32 @@ static int data_handler(void *user, const char *section, const char *name,
         {
             option.output_line_delay = read_integer(value, name, 0, LONG_MAX);
         }
+        else if (!strcmp(name, "output-line-sync"))
+        {
+            option.output_line_sync = line_sync_option_parse(value);
+        }
+        else if (!strcmp(name, "output-line-prompt"))
+        {
+            asprintf(&c.output_line_prompt, "%s", value);
+            option.output_line_prompt = c.output_line_prompt;
+        }
+        else if (!strcmp(name, "output-latency"))
+        {
+            option.output_latency = read_integer(value, name, 0, LONG_MAX);
+        }
         else if (!strcmp(name, "line-pulse-duration"))
         {
             line_pulse_duration_option_parse(value);
         }
+        else if (!strncmp(name, "line-sequence-", strlen("line-sequence-")))
+        {
+            if (sequence_define(name + strlen("line-sequence-"), value) < 0)
+            {
+                tio_error_printf("Invalid value '%s' for option '%s' in configuration file",
+                        value, name);
+                exit(EXIT_FAILURE);
+            }
+        }
         else if (!strcmp(name, "no-autoconnect"))
         {
             option.no_autoconnect = read_boolean(value, name);
@@ -183,6 +207,10 @@ static int data_handler(void *user, const char *section, const char *name,
         {
             option.output_mode = output_mode_option_parse(value);
         }
+        else if (!strcmp(name, "hex-mode-width"))
+        {
+            option.hex_mode_width = hex_mode_width_option_parse(value);
+        }
         else if (!strcmp(name, "timestamp"))
         {
             option.timestamp = read_boolean(value, name) ?
@@ -192,6 +220,14 @@ static int data_handler(void *user, const char *section, const char *name,
         {
             option.timestamp = timestamp_option_parse(value);
         }
+        else if (!strcmp(name, "timestamp-resolution"))
+        {
+            option.timestamp_resolution = timestamp_resolution_option_parse(value);
+        }
+        else if (!strcmp(name, "timestamp-timeout"))
+        {
+            option.timestamp_timeout = read_integer(value, name, 0, LONG_MAX);
+        }
         else if (!strcmp(name, "color"))
         {
             if (!strcmp(value, "list"))
@@ -458,6 +494,7 @@ void config_exit(void)
     free(c.parity);
     free(c.log_filename);
     free(c.map);
+    free(c.output_line_prompt);
 
     free(c.match);
     free(c.section_name);
@@ -0,0 +1,377 @@
+/*
+ * tio - a serial device I/O tool
+ *
+ * Copyright (c) 2014-2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Hex output engine.
+ *
+ * With a width of 0 each byte is printed as "xx " in one continuous stream.
+ * Otherwise traditional hexdump lines are printed:
+ *
+ *   [timestamp] 00000000  74 65 73 74 20 74 65 73  74 20 74 65 73 74 20 74  |test test test t|
+ *
+ * Lines are built incrementally so the output does not depend on how the
+ * received data is split into chunks.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "options.h"
+#include "print.h"
+#include "timestamp.h"
+#include "hexdump.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HEXDUMP_HAVE_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define HEXDUMP_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+#define HEXDUMP_GROUP 8
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int hex_width = 0;
+static unsigned char hex_line[HEXDUMP_WIDTH_MAX];
+static size_t hex_line_count = 0;
+static unsigned long hex_offset = 0;
+static char hex_table[256][2];
+static char ascii_table[256];
+static bool tables_ready = false;
+static const timestamp_stamp_t *hex_stamp = NULL;
+static bool hex_stream_active = false;
+
+static size_t (*hex_format_func)(char *dst, const unsigned char *src, size_t count);
+
+static size_t hex_format_scalar(char *dst, const unsigned char *src, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        dst[i*3]   = hex_table[src[i]][0];
+        dst[i*3+1] = hex_table[src[i]][1];
+        dst[i*3+2] = ' ';
+    }
+
+    return count * 3;
+}
+
+#ifdef HEXDUMP_HAVE_X86
+/* Shuffle masks spreading 16 interleaved digit pairs over 3 output vectors
+ * with room for the separating spaces */
+static uint8_t ssse3_lo[3][16], ssse3_hi[3][16], ssse3_space[16*3];
+
+static void hex_format_ssse3_init(void)
+{
+    for (int k = 0; k < 48; k++)
+    {
+        int j = k / 3, r = k % 3;
+
+        ssse3_lo[k / 16][k % 16] = ((r < 2) && (j < 8)) ? 2*j + r : 0x80;
+        ssse3_hi[k / 16][k % 16] = ((r < 2) && (j >= 8)) ? 2*(j - 8) + r : 0x80;
+        ssse3_space[k] = (r == 2) ? ' ' : 0;
+    }
+}
+
+__attribute__((target("ssse3")))
+static size_t hex_format_ssse3(char *dst, const unsigned char *src, size_t count)
+{
+    const __m128i digits = _mm_loadu_si128((const __m128i *)hex_digits);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    size_t i;
+
+    for (i = 0; i + 16 <= count; i += 16)
+    {
+        __m128i v  = _mm_loadu_si128((const __m128i *)&src[i]);
+        __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(v, nibble));
+        __m128i p0 = _mm_unpacklo_epi8(hi, lo);
+        __m128i p1 = _mm_unpackhi_epi8(hi, lo);
+
+        for (int k = 0; k < 3; k++)
+        {
+            __m128i out = _mm_or_si128(_mm_shuffle_epi8(p0, _mm_loadu_si128((const __m128i *)ssse3_lo[k])),
+                                       _mm_shuffle_epi8(p1, _mm_loadu_si128((const __m128i *)ssse3_hi[k])));
+            out = _mm_or_si128(out, _mm_loadu_si128((const __m128i *)&ssse3_space[k*16]));
+            _mm_storeu_si128((__m128i *)&dst[i*3 + k*16], out);
+        }
+    }
+
+    return i * 3 + hex_format_scalar(&dst[i*3], &src[i], count - i);
+}
+#endif
+
+#ifdef HEXDUMP_HAVE_NEON
+static size_t hex_format_neon(char *dst, const unsigned char *src, size_t count)
+{
+    const uint8x16_t digits = vld1q_u8((const uint8_t *)hex_digits);
+    size_t i;
+
+    for (i = 0; i + 16 <= count; i += 16)
+    {
+        uint8x16_t v = vld1q_u8(&src[i]);
+        uint8x16x3_t out;
+
+        out.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(v, 4));
+        out.val[1] = vqtbl1q_u8(digits, vandq_u8(v, vdupq_n_u8(0x0f)));
+        out.val[2] = vdupq_n_u8(' ');
+        vst3q_u8((uint8_t *)&dst[i*3], out);
+    }
+
+    return i * 3 + hex_format_scalar(&dst[i*3], &src[i], count - i);
+}
+#endif
+
+static void hexdump_tables_init(void)
+{
+    for (int c = 0; c < 256; c++)
+    {
+        hex_table[c][0] = hex_digits[c >> 4];
+        hex_table[c][1] = hex_digits[c & 0xf];
+        ascii_table[c] = ((c >= 0x20) && (c <= 0x7e)) ? c : '.';
+    }
+
+    hex_format_func = hex_format_scalar;
+#if defined(HEXDUMP_HAVE_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3"))
+    {
+        hex_format_ssse3_init();
+        hex_format_func = hex_format_ssse3;
+    }
+#elif defined(HEXDUMP_HAVE_NEON)
+    hex_format_func = hex_format_neon;
+#endif
+
+    tables_ready = true;
+}
+
+/* Format count bytes as "xx " each, dst must hold count * 3 characters */
+size_t hexdump_format(char *dst, const char *src, size_t count)
+{
+    if (!tables_ready)
+    {
+        hexdump_tables_init();
+    }
+
+    return hex_format_func(dst, (const unsigned char *) src, count);
+}
+
+void hexdump_init(int width)
+{
+    if (!tables_ready)
+    {
+        hexdump_tables_init();
+    }
+
+    hex_width = (width > HEXDUMP_WIDTH_MAX) ? HEXDUMP_WIDTH_MAX : width;
+    hex_line_count = 0;
+    hex_offset = 0;
+    hex_stream_active = false;
+}
+
+/* Use arrival time of received data for line timestamps, NULL for current time */
+void hexdump_stamp_set(const timestamp_stamp_t *stamp)
+{
+    hex_stamp = stamp;
+}
+
+static void hexdump_line_start(void)
+{
+    if (option.timestamp)
+    {
+        char *now = hex_stamp ? timestamp_format(hex_stamp) : timestamp_current_time();
+        if (now)
+        {
+            ansi_printf_raw("[%s] ", now);
+        }
+    }
+
+    printf("%08lx  ", hex_offset);
+}
+
+/* Print hex columns of count bytes placed at position in current line */
+static void hexdump_columns(const unsigned char *src, size_t position, size_t count)
+{
+    char formatted[HEXDUMP_WIDTH_MAX * 3];
+    char out[HEXDUMP_WIDTH_MAX * 4];
+    size_t i = 0, length = 0;
+
+    hex_format_func(formatted, src, count);
+
+    while (i < count)
+    {
+        size_t n = HEXDUMP_GROUP - ((position + i) % HEXDUMP_GROUP);
+
+        if (n > count - i)
+        {
+            n = count - i;
+        }
+
+        // Extra space in between groups of 8 bytes
+        if (((position + i) % HEXDUMP_GROUP) == 0 && (position + i) > 0)
+        {
+            out[length++] = ' ';
+        }
+
+        memcpy(&out[length], &formatted[i*3], n * 3);
+        length += n * 3;
+        i += n;
+    }
+
+    fwrite(out, 1, length, stdout);
+}
+
+static void hexdump_line_end(void)
+{
+    char out[HEXDUMP_WIDTH_MAX + 5];
+    size_t length = 0;
+
+    out[length++] = ' ';
+    out[length++] = '|';
+    for (int i = 0; i < hex_width; i++)
+    {
+        out[length++] = ((size_t) i < hex_line_count) ? ascii_table[hex_line[i]] : ' ';
+    }
+    out[length++] = '|';
+    out[length++] = '\r';
+    out[length++] = '\n';
+
+    fwrite(out, 1, length, stdout);
+
+    hex_offset += hex_line_count;
+    hex_line_count = 0;
+}
+
+/* End current burst of data, next data starts on a new line */
+void hexdump_break(void)
+{
+    if (hex_width == 0)
+    {
+        if (hex_stream_active && print_tainted)
+        {
+            printf("\r\n");
+        }
+        hex_stream_active = false;
+        print_tainted = false;
+        return;
+    }
+
+    if (hex_line_count > 0)
+    {
+        // Pad missing columns, including group separators, to align ascii column
+        int pad = (hex_width - hex_line_count) * 3 + (hex_width - 1) / HEXDUMP_GROUP
+                  - (hex_line_count - 1) / HEXDUMP_GROUP;
+
+        if (print_tainted)
+        {
+            printf("%*s", pad, "");
+            hexdump_line_end();
+        }
+        else
+        {
+            // Line was interrupted by a tio message, don't print it again
+            hex_offset += hex_line_count;
+            hex_line_count = 0;
+        }
+    }
+
+    print_tainted = false;
+}
+
+void hexdump_write(const char *buffer, size_t count)
+{
+    const unsigned char *data = (const unsigned char *) buffer;
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    if (hex_width == 0)
+    {
+        char formatted[BUFSIZ * 3];
+
+        // Each burst of the continuous stream starts with a timestamp
+        if (!hex_stream_active || !print_tainted)
+        {
+            if (option.timestamp)
+            {
+                char *now = hex_stamp ? timestamp_format(hex_stamp) : timestamp_current_time();
+                if (now)
+                {
+                    ansi_printf_raw("[%s] ", now);
+                }
+            }
+            hex_stream_active = true;
+        }
+
+        // Continuous stream of hex values
+        while (count > 0)
+        {
+            size_t n = (count < BUFSIZ) ? count : BUFSIZ;
+            fwrite(formatted, 1, hexdump_format(formatted, (const char *) data, n), stdout);
+            data += n;
+            count -= n;
+        }
+        print_tainted = true;
+        return;
+    }
+
+    // A tio message interrupted current line, print it again
+    if ((hex_line_count > 0) && (!print_tainted))
+    {
+        hexdump_line_start();
+        hexdump_columns(hex_line, 0, hex_line_count);
+    }
+
+    while (count > 0)
+    {
+        size_t n = hex_width - hex_line_count;
+
+        if (n > count)
+        {
+            n = count;
+        }
+
+        if (hex_line_count == 0)
+        {
+            hexdump_line_start();
+        }
+
+        hexdump_columns(data, hex_line_count, n);
+        memcpy(&hex_line[hex_line_count], data, n);
+        hex_line_count += n;
+        data += n;
+        count -= n;
+
+        if (hex_line_count == (size_t) hex_width)
+        {
+            hexdump_line_end();
+        }
+    }
+
+    print_tainted = (hex_line_count > 0);
+}
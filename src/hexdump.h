@@ -0,0 +1,33 @@
+/*
+ * tio - a serial device I/O tool
+ *
+ * Copyright (c) 2014-2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "timestamp.h"
+
+#define HEXDUMP_WIDTH_MAX 32
+
+void hexdump_init(int width);
+void hexdump_stamp_set(const timestamp_stamp_t *stamp);
+void hexdump_write(const char *buffer, size_t count);
+void hexdump_break(void);
+size_t hexdump_format(char *dst, const char *src, size_t count);
@@ -34,6 +34,7 @@
 #include "print.h"
 #include "error.h"
 #include "misc.h"
+#include "scan.h"
 
 #define IS_ESC_CSI_INTERMEDIATE_CHAR(c) ((c >= 0x20) && (c <= 0x3F))
 #define IS_ESC_END_CHAR(c)              ((c >= 0x30) && (c <= 0x7E))
@@ -42,6 +43,8 @@
 static FILE *fp = NULL;
 static char file_buffer[BUFSIZ];
 static const char *log_filename = NULL;
+static char strip_previous_char = 0;
+static bool strip_esc_sequence = false;
 
 static char *date_time(void)
 {
@@ -113,8 +116,6 @@ int log_open(const char *filename)
 
 bool log_strip(char c)
 {
-    static char previous_char = 0;
-    static bool esc_sequence = false;
     bool strip = false;
 
     /* Detect if character should be stripped or not */
@@ -124,7 +125,7 @@ bool log_strip(char c)
             /* Line feed / new line */
             /* Reset ESC sequence just in case something went wrong with the
              * escape sequence parsing. */
-            esc_sequence = false;
+            strip_esc_sequence = false;
             break;
 
         case 0x1b:
@@ -134,10 +135,10 @@ bool log_strip(char c)
 
         case 0x5b:
             /* Left bracket */
-            if (previous_char == 0x1b)
+            if (strip_previous_char == 0x1b)
             {
                 // Start of ESC sequence
-                esc_sequence = true;
+                strip_esc_sequence = true;
                 strip = true;
             }
             break;
@@ -150,22 +151,22 @@ bool log_strip(char c)
                 break;
             }
             else
-            if ((esc_sequence) && (IS_ESC_CSI_INTERMEDIATE_CHAR(c)))
+            if ((strip_esc_sequence) && (IS_ESC_CSI_INTERMEDIATE_CHAR(c)))
             {
                 strip = true;
                 break;
             }
             else
-            if ((esc_sequence) && (IS_ESC_END_CHAR(c)))
+            if ((strip_esc_sequence) && (IS_ESC_END_CHAR(c)))
             {
-                esc_sequence = false;
+                strip_esc_sequence = false;
                 strip = true;
                 break;
             }
             break;
     }
 
-    previous_char = c;
+    strip_previous_char = c;
 
     return strip;
 }
@@ -209,6 +210,45 @@ void log_putc(char c)
     }
 }
 
+void log_write(const char *buffer, size_t count)
+{
+    size_t i = 0, n;
+
+    if (fp == NULL)
+    {
+        return;
+    }
+
+    if (option.log_strip)
+    {
+        while (i < count)
+        {
+            if ((!strip_esc_sequence) && (strip_previous_char != 0x1b))
+            {
+                /* Outside of ESC sequences only control characters are stripped */
+                n = scan_ctrl(&buffer[i], count - i);
+                if (n > 0)
+                {
+                    fwrite(&buffer[i], 1, n, fp);
+                    strip_previous_char = buffer[i + n - 1];
+                    i += n;
+                    continue;
+                }
+            }
+
+            if (!log_strip(buffer[i]))
+            {
+                fputc(buffer[i], fp);
+            }
+            i++;
+        }
+    }
+    else
+    {
+        fwrite(buffer, 1, count, fp);
+    }
+}
+
 void log_close(void)
 {
     if (fp != NULL)
@@ -46,6 +46,29 @@ void delay(long ms)
     nanosleep(&ts, NULL);
 }
 
+uint64_t monotonic_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Return the time to wait [ms] for a monotonic_us() deadline, rounded up so
+ * a poll does not wake up just before it, or 0 if it has passed */
+int deadline_timeout(uint64_t deadline)
+{
+    uint64_t now = monotonic_us();
+
+    if (deadline <= now)
+    {
+        return 0;
+    }
+
+    return (deadline - now + 999) / 1000;
+}
+
 long string_to_long(char *string)
 {
     long result;
@@ -72,6 +95,7 @@ int ctrl_key_code(unsigned char key)
     return -1;
 }
 
+#ifdef _WIN32
 LPSTR GetErrorMessage(DWORD dwErrorCode)
 {
     static TCHAR Buf[255];
@@ -86,6 +110,7 @@ LPSTR GetErrorMessage(DWORD dwErrorCode)
                     NULL);
     return Buf;
 }
+#endif
 
 bool fs_dir_exists(const char *path)
 {
@@ -22,17 +22,32 @@
 #pragma once
 
 #include "serialport.h"
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <errno.h>
+#include <string.h>
+#endif
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #define UNUSED(expr) do { (void)(expr); } while (0)
 
+#ifdef _WIN32
 LPSTR GetErrorMessage(DWORD dwErrorCode);
+#else
+#define GetLastError() errno
+#define GetErrorMessage(err) strerror(err)
+#define InterlockedCompareExchange(dest, exchange, comparand) \
+    __sync_val_compare_and_swap(dest, comparand, exchange)
+#endif
 
 char * current_time(void);
 void delay(long ms);
+uint64_t monotonic_us(void);
+int deadline_timeout(uint64_t deadline);
 long string_to_long(char *string);
 int ctrl_key_code(unsigned char key);
 void alert_connect(void);
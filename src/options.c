@@ -42,6 +42,8 @@ enum opt_t
 {
     OPT_NONE,
     OPT_TIMESTAMP_FORMAT,
+    OPT_TIMESTAMP_RESOLUTION,
+    OPT_TIMESTAMP_TIMEOUT,
     OPT_LOG_FILE,
     OPT_LOG_DIRECTORY,
     OPT_LOG_STRIP,
@@ -55,6 +57,10 @@ enum opt_t
     OPT_SCRIPT_RUN,
     OPT_INPUT_MODE,
     OPT_OUTPUT_MODE,
+    OPT_OUTPUT_LATENCY,
+    OPT_OUTPUT_LINE_SYNC,
+    OPT_OUTPUT_LINE_PROMPT,
+    OPT_HEX_MODE_WIDTH,
 };
 
 /* Default options */
@@ -68,6 +74,9 @@ struct option_t option =
     .parity = "none",
     .output_delay = 0,
     .output_line_delay = 0,
+    .output_line_sync = LINE_SYNC_NONE,
+    .output_line_prompt = NULL,
+    .output_latency = 5,
     .dtr_pulse_duration = 100,
     .rts_pulse_duration = 100,
     .pulse_duration = 100,
@@ -79,11 +88,14 @@ struct option_t option =
     .log_strip = false,
     .local_echo = false,
     .timestamp = TIMESTAMP_NONE,
+    .timestamp_resolution = TIMESTAMP_RESOLUTION_MS,
+    .timestamp_timeout = 0,
     .socket = NULL,
     .map = "",
     .color = 256, // Bold
     .input_mode = INPUT_MODE_NORMAL,
     .output_mode = OUTPUT_MODE_NORMAL,
+    .hex_mode_width = 0,
     .prefix_code = 20, // ctrl-t
     .prefix_key = 't',
     .prefix_enabled = true,
@@ -111,13 +123,19 @@ void print_help(char *argv[])
     printf("  -p, --parity odd|even|none|mark|space  Parity (default: none)\n");
     printf("  -o, --output-delay <ms>                Output character delay (default: 0)\n");
     printf("  -O, --output-line-delay <ms>           Output line delay (default: 0)\n");
+    printf("      --output-line-sync <mode>          Send next line on echo or prompt (default: none)\n");
+    printf("      --output-line-prompt <regex>       Prompt which ends a line in prompt sync mode\n");
+    printf("      --output-latency <ms>              Maximum terminal output latency (default: 5)\n");
     printf("      --line-pulse-duration <duration>   Set line pulse duration\n");
     printf("  -n, --no-autoconnect                   Disable automatic connect\n");
     printf("  -e, --local-echo                       Enable local echo\n");
     printf("      --input-mode normal|hex|line       Select input mode (default: normal)\n");
     printf("      --output-mode normal|hex           Select output mode (default: normal)\n");
+    printf("      --hex-mode-width 0|4|8|16|32       Bytes per line in hex output mode (default: 0)\n");
     printf("  -t, --timestamp                        Enable line timestamp\n");
     printf("      --timestamp-format <format>        Set timestamp format (default: 24hour)\n");
+    printf("      --timestamp-resolution ms|us       Set timestamp resolution (default: ms)\n");
+    printf("      --timestamp-timeout <ms>           Timestamp after input inactivity (default: 0)\n");
     printf("  -L, --list-devices                     List available serial devices by ID\n");
     printf("  -l, --log                              Enable log to file\n");
     printf("      --log-file <filename>              Set log filename\n");
@@ -228,6 +246,46 @@ output_mode_t output_mode_option_parse(const char *arg)
     }
 }
 
+line_sync_t line_sync_option_parse(const char *arg)
+{
+    if (strcmp("none", arg) == 0)
+    {
+        return LINE_SYNC_NONE;
+    }
+    else if (strcmp("echo", arg) == 0)
+    {
+        return LINE_SYNC_ECHO;
+    }
+    else if (strcmp("prompt", arg) == 0)
+    {
+        return LINE_SYNC_PROMPT;
+    }
+    else
+    {
+        tio_error_printf("Invalid output line sync option");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int hex_mode_width_option_parse(const char *arg)
+{
+    int width = atoi(arg);
+
+    switch (width)
+    {
+        case 0:
+        case 4:
+        case 8:
+        case 16:
+        case 32:
+            return width;
+
+        default:
+            tio_error_printf("Invalid hex mode width option");
+            exit(EXIT_FAILURE);
+    }
+}
+
 const char *input_mode_by_string(input_mode_t mode)
 {
     switch (mode)
@@ -245,6 +303,21 @@ const char *input_mode_by_string(input_mode_t mode)
     return NULL;
 }
 
+const char *line_sync_by_string(line_sync_t sync)
+{
+    switch (sync)
+    {
+        case LINE_SYNC_NONE:
+            return "none";
+        case LINE_SYNC_ECHO:
+            return "echo";
+        case LINE_SYNC_PROMPT:
+            return "prompt";
+    }
+
+    return NULL;
+}
+
 const char *output_mode_by_string(output_mode_t mode)
 {
     switch (mode)
@@ -291,14 +364,23 @@ void options_print()
     tio_printf(" Parity: %s", option.parity);
     tio_printf(" Local echo: %s", option.local_echo ? "enabled" : "disabled");
     tio_printf(" Timestamp: %s", timestamp_state_to_string(option.timestamp));
+    tio_printf(" Timestamp resolution: %s", option.timestamp_resolution == TIMESTAMP_RESOLUTION_US ? "us" : "ms");
+    tio_printf(" Timestamp timeout: %d", option.timestamp_timeout);
     tio_printf(" Output delay: %d", option.output_delay);
     tio_printf(" Output line delay: %d", option.output_line_delay);
+    tio_printf(" Output line sync: %s", line_sync_by_string(option.output_line_sync));
+    if (option.output_line_prompt)
+    {
+        tio_printf(" Output line prompt: %s", option.output_line_prompt);
+    }
+    tio_printf(" Output latency: %d", option.output_latency);
     tio_printf(" Auto connect: %s", option.no_autoconnect ? "disabled" : "enabled");
     tio_printf(" Pulse duration: DTR=%d RTS=%d DEF=%d ", option.dtr_pulse_duration,
                                                          option.rts_pulse_duration,
                                                          option.pulse_duration);
     tio_printf(" Input mode: %s", input_mode_by_string(option.input_mode));
     tio_printf(" Output mode: %s", output_mode_by_string(option.output_mode));
+    tio_printf(" Hex mode width: %d", option.hex_mode_width);
     if (option.map[0] != 0)
         tio_printf(" Map flags: %s", option.map);
     if (option.log)
@@ -333,11 +415,16 @@ void options_parse(int argc, char *argv[])
             {"parity",               required_argument, 0, 'p'                     },
             {"output-delay",         required_argument, 0, 'o'                     },
             {"output-line-delay" ,   required_argument, 0, 'O'                     },
+            {"output-line-sync",     required_argument, 0, OPT_OUTPUT_LINE_SYNC    },
+            {"output-line-prompt",   required_argument, 0, OPT_OUTPUT_LINE_PROMPT  },
+            {"output-latency",       required_argument, 0, OPT_OUTPUT_LATENCY      },
             {"line-pulse-duration",  required_argument, 0, OPT_LINE_PULSE_DURATION },
             {"no-autoconnect",       no_argument,       0, 'n'                     },
             {"local-echo",           no_argument,       0, 'e'                     },
             {"timestamp",            no_argument,       0, 't'                     },
             {"timestamp-format",     required_argument, 0, OPT_TIMESTAMP_FORMAT    },
+            {"timestamp-resolution", required_argument, 0, OPT_TIMESTAMP_RESOLUTION},
+            {"timestamp-timeout",    required_argument, 0, OPT_TIMESTAMP_TIMEOUT   },
             {"list-devices",         no_argument,       0, 'L'                     },
             {"log",                  no_argument,       0, 'l'                     },
             {"log-file",             required_argument, 0, OPT_LOG_FILE            },
@@ -349,6 +436,7 @@ void options_parse(int argc, char *argv[])
             {"color",                required_argument, 0, 'c'                     },
             {"input-mode",           required_argument, 0, OPT_INPUT_MODE          },
             {"output-mode",          required_argument, 0, OPT_OUTPUT_MODE         },
+            {"hex-mode-width",       required_argument, 0, OPT_HEX_MODE_WIDTH      },
             {"alert",                required_argument, 0, OPT_ALERT               },
             {"mute",                 no_argument,       0, OPT_MUTE                },
             {"script",               required_argument, 0, OPT_SCRIPT              },
@@ -410,6 +498,18 @@ void options_parse(int argc, char *argv[])
                 option.output_line_delay = string_to_long(optarg);
                 break;
 
+            case OPT_OUTPUT_LINE_SYNC:
+                option.output_line_sync = line_sync_option_parse(optarg);
+                break;
+
+            case OPT_OUTPUT_LINE_PROMPT:
+                option.output_line_prompt = optarg;
+                break;
+
+            case OPT_OUTPUT_LATENCY:
+                option.output_latency = string_to_long(optarg);
+                break;
+
             case OPT_LINE_PULSE_DURATION:
                 line_pulse_duration_option_parse(optarg);
                 break;
@@ -430,6 +530,14 @@ void options_parse(int argc, char *argv[])
                 option.timestamp = timestamp_option_parse(optarg);
                 break;
 
+            case OPT_TIMESTAMP_RESOLUTION:
+                option.timestamp_resolution = timestamp_resolution_option_parse(optarg);
+                break;
+
+            case OPT_TIMESTAMP_TIMEOUT:
+                option.timestamp_timeout = string_to_long(optarg);
+                break;
+
             case 'L':
                 list_serial_devices();
                 exit(EXIT_SUCCESS);
@@ -501,6 +609,10 @@ void options_parse(int argc, char *argv[])
                 option.output_mode = output_mode_option_parse(optarg);
                 break;
 
+            case OPT_HEX_MODE_WIDTH:
+                option.hex_mode_width = hex_mode_width_option_parse(optarg);
+                break;
+
             case OPT_ALERT:
                 option.alert = alert_option_parse(optarg);
                 break;
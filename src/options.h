@@ -44,6 +44,13 @@ typedef enum
     OUTPUT_MODE_END,
 } output_mode_t;
 
+typedef enum
+{
+    LINE_SYNC_NONE,
+    LINE_SYNC_ECHO,
+    LINE_SYNC_PROMPT,
+} line_sync_t;
+
 /* Options */
 struct option_t
 {
@@ -55,6 +62,9 @@ struct option_t
     char *parity;
     int output_delay;
     int output_line_delay;
+    line_sync_t output_line_sync;
+    const char *output_line_prompt;
+    int output_latency;
     unsigned int dtr_pulse_duration;
     unsigned int rts_pulse_duration;
     unsigned int pulse_duration;
@@ -64,6 +74,8 @@ struct option_t
     bool log_strip;
     bool local_echo;
     enum timestamp_t timestamp;
+    enum timestamp_resolution_t timestamp_resolution;
+    int timestamp_timeout;
     const char *log_filename;
     const char *log_directory;
     const char *map;
@@ -71,6 +83,7 @@ struct option_t
     int color;
     input_mode_t input_mode;
     output_mode_t output_mode;
+    int hex_mode_width;
     unsigned char prefix_code;
     unsigned char prefix_key;
     bool prefix_enabled;
@@ -93,3 +106,5 @@ enum script_run_t script_run_option_parse(const char *arg);
 
 input_mode_t input_mode_option_parse(const char *arg);
 output_mode_t output_mode_option_parse(const char *arg);
+line_sync_t line_sync_option_parse(const char *arg);
+int hex_mode_width_option_parse(const char *arg);
@@ -25,10 +25,17 @@
 #include <string.h>
 #include "options.h"
 #include "print.h"
+#include "hexdump.h"
+
+#define STDOUT_BUFFER_SIZE (64*1024)
 
 bool print_tainted = false;
 char ansi_format[30];
 
+static char stdout_buffer[STDOUT_BUFFER_SIZE];
+static bool flush_pending = false;
+static uint64_t flush_deadline;
+
 static char *
 strndup (const char *s, size_t n)
 {
@@ -44,8 +51,7 @@ strndup (const char *s, size_t n)
 
 void print_hex(char c)
 {
-    print_tainted = true;
-    printf("%02x ", (unsigned char) c);
+    hexdump_write(&c, 1);
 }
 
 void print_normal(char c)
@@ -54,6 +60,17 @@ void print_normal(char c)
     putchar(c);
 }
 
+void print_hex_buffer(const char *buffer, size_t count)
+{
+    hexdump_write(buffer, count);
+}
+
+void print_normal_buffer(const char *buffer, size_t count)
+{
+    print_tainted = true;
+    fwrite(buffer, 1, count, stdout);
+}
+
 void print_init_ansi_formatting()
 {
     if (option.color == 256)
@@ -68,6 +85,53 @@ void print_init_ansi_formatting()
     }
 }
 
+void print_init_output_buffering(void)
+{
+    /* Output is fully buffered and flushed explicitly, see print_flush_arm() */
+    setvbuf(stdout, stdout_buffer, _IOFBF, sizeof(stdout_buffer));
+}
+
+void print_flush(void)
+{
+    fflush(stdout);
+    flush_pending = false;
+}
+
+/* Request flush of buffered output within the configured latency. Output
+ * keeps accumulating until then, so a busy stream costs few writes. */
+void print_flush_arm(void)
+{
+    if (option.output_latency <= 0)
+    {
+        print_flush();
+        return;
+    }
+
+    if (!flush_pending)
+    {
+        flush_deadline = monotonic_us() + option.output_latency * 1000ULL;
+        flush_pending = true;
+    }
+}
+
+/* Flush output if the deadline has passed and return the time to wait [ms]
+ * for the next deadline, or -1 if there is none. */
+int print_flush_timeout(void)
+{
+    if (!flush_pending)
+    {
+        return -1;
+    }
+
+    if (monotonic_us() >= flush_deadline)
+    {
+        print_flush();
+        return -1;
+    }
+
+    return deadline_timeout(flush_deadline);
+}
+
 void tio_printf_array(const char *array)
 {
     int i = 0, j = 0;
@@ -48,6 +48,7 @@ extern char ansi_format[];
 { \
     if (!option.mute) \
     { \
+        print_flush(); \
         if (option.color < 0) \
         fprintf (stderr, "\r" format "\r\n", ## args); \
         else \
@@ -77,6 +78,7 @@ extern char ansi_format[];
         fprintf (stdout, "\r[%s] Warning: " format "\r\n", timestamp_current_time(), ## args); \
         else \
         ansi_printf("\e[1;31m[%s] Warning: " format, timestamp_current_time(), ## args); \
+        print_flush(); \
     } \
 }
 
@@ -90,6 +92,7 @@ extern char ansi_format[];
         fprintf (stdout, "\r[%s] Error: " format "\r\n", timestamp_current_time(), ## args); \
         else \
         ansi_printf("\e[1;31m[%s] Error: " format, timestamp_current_time(), ## args); \
+        print_flush(); \
     } \
 }
 
@@ -101,6 +104,7 @@ extern char ansi_format[];
         putchar('\n'); \
         ansi_printf("[%s] " format, timestamp_current_time(), ## args); \
         print_tainted = false; \
+        print_flush(); \
     } \
 }
 
@@ -112,6 +116,7 @@ extern char ansi_format[];
         putchar('\n'); \
         ansi_printf_raw("[%s] " format, timestamp_current_time(), ## args); \
         print_tainted = false; \
+        print_flush(); \
     } \
 }
 
@@ -127,6 +132,12 @@ extern char ansi_format[];
 
 void print_hex(char c);
 void print_normal(char c);
+void print_hex_buffer(const char *buffer, size_t count);
+void print_normal_buffer(const char *buffer, size_t count);
 void print_init_ansi_formatting(void);
+void print_init_output_buffering(void);
+void print_flush(void);
+void print_flush_arm(void);
+int print_flush_timeout(void);
 void tio_printf_array(const char *array);
 void print_tainted_set(void);
@@ -0,0 +1,657 @@
+/*
+ * tio - a serial device I/O tool
+ *
+ * Copyright (c) 2014-2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Byte classification kernels for received data.
+ *
+ * Nearly all received bytes are plain data which is passed through as is,
+ * only a handful of characters (newline, carriage return, form feed, escape
+ * and other control characters) need per-byte handling. These helpers find
+ * the next such byte so callers only branch where it matters.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_HAVE_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SCAN_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+#define CTRL_CHAR_LIMIT 0x20
+
+typedef size_t (*scan_chars_func_t)(const scan_set_t *set, const unsigned char *buffer, size_t count);
+typedef size_t (*scan_ctrl_func_t)(const unsigned char *buffer, size_t count);
+typedef size_t (*scan_hex_func_t)(unsigned char *dst, const unsigned char *src, size_t count);
+
+static enum scan_impl_t scan_impl = SCAN_IMPL_AUTO;
+static scan_chars_func_t scan_chars_func = NULL;
+static scan_ctrl_func_t scan_ctrl_func = NULL;
+static scan_hex_func_t scan_hex_func = NULL;
+
+static inline int hex_nibble(unsigned char c)
+{
+    if ((c >= '0') && (c <= '9'))
+    {
+        return c - '0';
+    }
+
+    c |= 0x20;
+    if ((c >= 'a') && (c <= 'f'))
+    {
+        return c - 'a' + 10;
+    }
+
+    return -1;
+}
+
+/* Word at a time tests for targets without SIMD. A flag is set in the
+ * high bit of each byte which is zero, or below n, the lowest flag is
+ * always exact. */
+#define SWAR_ONES  0x0101010101010101ULL
+#define SWAR_HIGHS 0x8080808080808080ULL
+
+static inline uint64_t swar_load(const unsigned char *buffer)
+{
+    uint64_t word;
+
+    memcpy(&word, buffer, sizeof(word));
+    return word;
+}
+
+static inline uint64_t swar_zero(uint64_t word)
+{
+    return (word - SWAR_ONES) & ~word & SWAR_HIGHS;
+}
+
+static inline uint64_t swar_below(uint64_t word, unsigned char n)
+{
+    return (word - SWAR_ONES * n) & ~word & SWAR_HIGHS;
+}
+
+static size_t scan_chars_scalar(const scan_set_t *set, const unsigned char *buffer, size_t count)
+{
+    const uint64_t c0 = SWAR_ONES * set->chars[0];
+    const uint64_t c1 = SWAR_ONES * set->chars[1];
+    const uint64_t c2 = SWAR_ONES * set->chars[2];
+    const uint64_t c3 = SWAR_ONES * set->chars[3];
+    size_t i = 0;
+
+    if (set->count == 1)
+    {
+        const unsigned char *found = memchr(buffer, set->chars[0], count);
+        return found ? (size_t) (found - buffer) : count;
+    }
+
+    // Skip whole words without a match, the byte loop finds it in the word
+    for (; i + sizeof(uint64_t) <= count; i += sizeof(uint64_t))
+    {
+        uint64_t word = swar_load(&buffer[i]);
+        uint64_t found = swar_zero(word ^ c0) | swar_zero(word ^ c1);
+
+        if (set->count > 2)
+        {
+            found |= swar_zero(word ^ c2) | swar_zero(word ^ c3);
+        }
+        if (found)
+        {
+            break;
+        }
+    }
+
+    for (; i < count; i++)
+    {
+        unsigned char c = buffer[i];
+
+        if ((c == set->chars[0]) || (c == set->chars[1]) ||
+            (c == set->chars[2]) || (c == set->chars[3]))
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+static size_t scan_ctrl_scalar(const unsigned char *buffer, size_t count)
+{
+    size_t i = 0;
+
+    for (; i + sizeof(uint64_t) <= count; i += sizeof(uint64_t))
+    {
+        if (swar_below(swar_load(&buffer[i]), CTRL_CHAR_LIMIT))
+        {
+            break;
+        }
+    }
+
+    for (; i < count; i++)
+    {
+        if (buffer[i] < CTRL_CHAR_LIMIT)
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/* Decode consecutive hex digit pairs, stopping at the first non-hex character
+ * or unpaired digit. Returns number of source characters consumed. */
+static size_t scan_hex_scalar(unsigned char *dst, const unsigned char *src, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i + 2 <= count; i += 2)
+    {
+        int hi = hex_nibble(src[i]);
+        int lo = hex_nibble(src[i + 1]);
+
+        if ((hi < 0) || (lo < 0))
+        {
+            break;
+        }
+
+        dst[i / 2] = (unsigned char) ((hi << 4) | lo);
+    }
+
+    return i;
+}
+
+#ifdef SCAN_HAVE_X86
+__attribute__((target("sse2")))
+static size_t scan_chars_sse2(const scan_set_t *set, const unsigned char *buffer, size_t count)
+{
+    const __m128i c0 = _mm_set1_epi8(set->chars[0]);
+    const __m128i c1 = _mm_set1_epi8(set->chars[1]);
+    const __m128i c2 = _mm_set1_epi8(set->chars[2]);
+    const __m128i c3 = _mm_set1_epi8(set->chars[3]);
+    size_t i;
+
+    for (i = 0; i + 16 <= count; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)&buffer[i]);
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, c0), _mm_cmpeq_epi8(v, c1)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, c2), _mm_cmpeq_epi8(v, c3)));
+        unsigned int mask = _mm_movemask_epi8(m);
+
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + scan_chars_scalar(set, &buffer[i], count - i);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_ctrl_sse2(const unsigned char *buffer, size_t count)
+{
+    const __m128i limit = _mm_set1_epi8(CTRL_CHAR_LIMIT - 1);
+    size_t i;
+
+    for (i = 0; i + 16 <= count; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)&buffer[i]);
+        // Unsigned v <= limit
+        unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, limit), v));
+
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + scan_ctrl_scalar(&buffer[i], count - i);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_hex_sse2(unsigned char *dst, const unsigned char *src, size_t count)
+{
+    const __m128i ascii_0 = _mm_set1_epi8('0');
+    const __m128i ascii_a = _mm_set1_epi8('a');
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i five = _mm_set1_epi8(5);
+    const __m128i ten = _mm_set1_epi8(10);
+    const __m128i low_byte = _mm_set1_epi16(0x00ff);
+    size_t i;
+
+    for (i = 0; i + 16 <= count; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)&src[i]);
+        __m128i d = _mm_sub_epi8(v, ascii_0);
+        __m128i a = _mm_sub_epi8(_mm_or_si128(v, lower), ascii_a);
+        // Unsigned d <= 9 and a <= 5
+        __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(d, nine), d);
+        __m128i is_alpha = _mm_cmpeq_epi8(_mm_min_epu8(a, five), a);
+
+        if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) != 0xffff)
+        {
+            break;
+        }
+
+        __m128i n = _mm_or_si128(_mm_and_si128(is_digit, d),
+                                 _mm_and_si128(is_alpha, _mm_add_epi8(a, ten)));
+        // Little endian: low byte of each 16-bit lane is the high nibble
+        __m128i b = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n, low_byte), 4),
+                                 _mm_srli_epi16(n, 8));
+
+        _mm_storel_epi64((__m128i *)&dst[i / 2], _mm_packus_epi16(b, b));
+    }
+
+    return i + scan_hex_scalar(&dst[i / 2], &src[i], count - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_chars_avx2(const scan_set_t *set, const unsigned char *buffer, size_t count)
+{
+    const __m256i c0 = _mm256_set1_epi8(set->chars[0]);
+    const __m256i c1 = _mm256_set1_epi8(set->chars[1]);
+    const __m256i c2 = _mm256_set1_epi8(set->chars[2]);
+    const __m256i c3 = _mm256_set1_epi8(set->chars[3]);
+    size_t i;
+
+    for (i = 0; i + 32 <= count; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&buffer[i]);
+        __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, c0), _mm256_cmpeq_epi8(v, c1)),
+                                    _mm256_or_si256(_mm256_cmpeq_epi8(v, c2), _mm256_cmpeq_epi8(v, c3)));
+        unsigned int mask = _mm256_movemask_epi8(m);
+
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + scan_chars_sse2(set, &buffer[i], count - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_ctrl_avx2(const unsigned char *buffer, size_t count)
+{
+    const __m256i limit = _mm256_set1_epi8(CTRL_CHAR_LIMIT - 1);
+    size_t i;
+
+    for (i = 0; i + 32 <= count; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&buffer[i]);
+        // Unsigned v <= limit
+        unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(v, limit), v));
+
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + scan_ctrl_sse2(&buffer[i], count - i);
+}
+#endif
+
+#ifdef SCAN_HAVE_NEON
+static inline uint64_t neon_mask(uint8x16_t m)
+{
+    // Narrow each byte to a nibble, 4 bits per input byte
+    uint8x8_t n = vshrn_n_u16(vreinterpretq_u16_u8(m), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(n), 0);
+}
+
+static size_t scan_chars_neon(const scan_set_t *set, const unsigned char *buffer, size_t count)
+{
+    const uint8x16_t c0 = vdupq_n_u8(set->chars[0]);
+    const uint8x16_t c1 = vdupq_n_u8(set->chars[1]);
+    const uint8x16_t c2 = vdupq_n_u8(set->chars[2]);
+    const uint8x16_t c3 = vdupq_n_u8(set->chars[3]);
+    size_t i;
+
+    for (i = 0; i + 16 <= count; i += 16)
+    {
+        uint8x16_t v = vld1q_u8(&buffer[i]);
+        uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, c0), vceqq_u8(v, c1)),
+                                vorrq_u8(vceqq_u8(v, c2), vceqq_u8(v, c3)));
+        uint64_t mask = neon_mask(m);
+
+        if (mask)
+        {
+            return i + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+
+    return i + scan_chars_scalar(set, &buffer[i], count - i);
+}
+
+static size_t scan_ctrl_neon(const unsigned char *buffer, size_t count)
+{
+    const uint8x16_t limit = vdupq_n_u8(CTRL_CHAR_LIMIT);
+    size_t i;
+
+    for (i = 0; i + 16 <= count; i += 16)
+    {
+        uint64_t mask = neon_mask(vcltq_u8(vld1q_u8(&buffer[i]), limit));
+
+        if (mask)
+        {
+            return i + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+
+    return i + scan_ctrl_scalar(&buffer[i], count - i);
+}
+
+static size_t scan_hex_neon(unsigned char *dst, const unsigned char *src, size_t count)
+{
+    const uint8x8_t ascii_0 = vdup_n_u8('0');
+    const uint8x8_t ascii_a = vdup_n_u8('a');
+    const uint8x8_t lower = vdup_n_u8(0x20);
+    const uint8x8_t nine = vdup_n_u8(9);
+    const uint8x8_t five = vdup_n_u8(5);
+    const uint8x8_t ten = vdup_n_u8(10);
+    uint8x8_t n[2];
+    size_t i;
+    int k;
+
+    for (i = 0; i + 16 <= count; i += 16)
+    {
+        // De-interleave into high (even) and low (odd) nibble characters
+        uint8x8x2_t v = vld2_u8(&src[i]);
+        uint8x8_t valid = vdup_n_u8(0xff);
+
+        for (k = 0; k < 2; k++)
+        {
+            uint8x8_t d = vsub_u8(v.val[k], ascii_0);
+            uint8x8_t a = vsub_u8(vorr_u8(v.val[k], lower), ascii_a);
+            uint8x8_t is_digit = vcle_u8(d, nine);
+            uint8x8_t is_alpha = vcle_u8(a, five);
+
+            valid = vand_u8(valid, vorr_u8(is_digit, is_alpha));
+            n[k] = vbsl_u8(is_digit, d, vadd_u8(a, ten));
+        }
+
+        if (vget_lane_u64(vreinterpret_u64_u8(valid), 0) != UINT64_MAX)
+        {
+            break;
+        }
+
+        vst1_u8(&dst[i / 2], vorr_u8(vshl_n_u8(n[0], 4), n[1]));
+    }
+
+    return i + scan_hex_scalar(&dst[i / 2], &src[i], count - i);
+}
+#endif
+
+static enum scan_impl_t scan_impl_detect(void)
+{
+#if defined(SCAN_HAVE_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return SCAN_IMPL_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return SCAN_IMPL_SSE2;
+    }
+#elif defined(SCAN_HAVE_NEON)
+    return SCAN_IMPL_NEON;
+#endif
+    return SCAN_IMPL_SCALAR;
+}
+
+bool scan_impl_select(enum scan_impl_t impl)
+{
+    enum scan_impl_t best = scan_impl_detect();
+
+    if (impl == SCAN_IMPL_AUTO)
+    {
+        impl = best;
+    }
+
+    switch (impl)
+    {
+        case SCAN_IMPL_SCALAR:
+            scan_chars_func = scan_chars_scalar;
+            scan_ctrl_func = scan_ctrl_scalar;
+            scan_hex_func = scan_hex_scalar;
+            break;
+
+#ifdef SCAN_HAVE_X86
+        case SCAN_IMPL_SSE2:
+            if (best != SCAN_IMPL_SSE2 && best != SCAN_IMPL_AVX2)
+            {
+                return false;
+            }
+            scan_chars_func = scan_chars_sse2;
+            scan_ctrl_func = scan_ctrl_sse2;
+            scan_hex_func = scan_hex_sse2;
+            break;
+
+        case SCAN_IMPL_AVX2:
+            if (best != SCAN_IMPL_AVX2)
+            {
+                return false;
+            }
+            scan_chars_func = scan_chars_avx2;
+            scan_ctrl_func = scan_ctrl_avx2;
+            scan_hex_func = scan_hex_sse2;
+            break;
+#endif
+
+#ifdef SCAN_HAVE_NEON
+        case SCAN_IMPL_NEON:
+            scan_chars_func = scan_chars_neon;
+            scan_ctrl_func = scan_ctrl_neon;
+            scan_hex_func = scan_hex_neon;
+            break;
+#endif
+
+        default:
+            return false;
+    }
+
+    scan_impl = impl;
+
+    return true;
+}
+
+const char *scan_impl_name(void)
+{
+    switch (scan_impl)
+    {
+        case SCAN_IMPL_SCALAR:
+            return "scalar";
+        case SCAN_IMPL_SSE2:
+            return "sse2";
+        case SCAN_IMPL_AVX2:
+            return "avx2";
+        case SCAN_IMPL_NEON:
+            return "neon";
+        default:
+            return "auto";
+    }
+}
+
+void scan_set_init(scan_set_t *set, const char *chars, size_t count)
+{
+    size_t i;
+
+    if (count > SCAN_SET_SIZE_MAX)
+    {
+        count = SCAN_SET_SIZE_MAX;
+    }
+
+    set->count = count;
+
+    // Pad unused slots with the first character so kernels always compare 4
+    for (i = 0; i < SCAN_SET_SIZE_MAX; i++)
+    {
+        set->chars[i] = count ? (unsigned char) chars[(i < count) ? i : 0] : 0;
+    }
+}
+
+/* Return offset of the first character of buffer which is part of set, or
+ * count if there is none. */
+size_t scan_chars(const scan_set_t *set, const char *buffer, size_t count)
+{
+    if (set->count == 0)
+    {
+        return count;
+    }
+
+    if (scan_chars_func == NULL)
+    {
+        scan_impl_select(SCAN_IMPL_AUTO);
+    }
+
+    return scan_chars_func(set, (const unsigned char *) buffer, count);
+}
+
+/* Return offset of the first ASCII control character (0x00-0x1f) of buffer,
+ * or count if there is none. */
+size_t scan_ctrl(const char *buffer, size_t count)
+{
+    if (scan_ctrl_func == NULL)
+    {
+        scan_impl_select(SCAN_IMPL_AUTO);
+    }
+
+    return scan_ctrl_func((const unsigned char *) buffer, count);
+}
+
+/* Decode a stream of hex digit pairs into dst, skipping whitespace, ':', ','
+ * and '0x' prefixes. Decoding stops before a trailing unpaired digit so it can
+ * be completed by the next buffer. Returns number of bytes written to dst,
+ * which must hold at least count / 2 bytes. */
+size_t scan_hex_decode(unsigned char *dst, const char *src, size_t count, size_t *consumed, size_t *invalid)
+{
+    const unsigned char *s = (const unsigned char *) src;
+    size_t written = 0;
+    size_t skipped = 0;
+    size_t i = 0;
+
+    if (scan_hex_func == NULL)
+    {
+        scan_impl_select(SCAN_IMPL_AUTO);
+    }
+
+    while (i < count)
+    {
+        unsigned char c = s[i];
+
+        if ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n') ||
+            (c == ':') || (c == ','))
+        {
+            i++;
+            continue;
+        }
+
+        if (hex_nibble(c) < 0)
+        {
+            skipped++;
+            i++;
+            continue;
+        }
+
+        if (i + 1 == count)
+        {
+            // Unpaired digit, leave it for the caller
+            break;
+        }
+
+        if ((c == '0') && ((s[i + 1] | 0x20) == 'x'))
+        {
+            i += 2;
+            continue;
+        }
+
+        if (hex_nibble(s[i + 1]) < 0)
+        {
+            // Lone digit followed by a separator
+            skipped++;
+            i++;
+            continue;
+        }
+
+        size_t n = scan_hex_func(&dst[written], &s[i], count - i);
+        written += n / 2;
+        i += n;
+    }
+
+    if (consumed != NULL)
+    {
+        *consumed = i;
+    }
+
+    if (invalid != NULL)
+    {
+        *invalid = skipped;
+    }
+
+    return written;
+}
+
+/* Same as scan_hex_decode() for a stream arriving in pieces. pending holds
+ * the high nibble left unpaired by the previous piece, or -1. It is
+ * completed by a leading digit, or dropped and counted invalid like a lone
+ * digit followed by a separator. A trailing unpaired digit is left in
+ * pending for the next piece. dst must hold at least count / 2 + 1 bytes. */
+size_t scan_hex_decode_stream(int *pending, unsigned char *dst, const char *src, size_t count, size_t *invalid)
+{
+    size_t written = 0, skipped = 0, start = 0, consumed;
+
+    if ((count > 0) && (*pending >= 0))
+    {
+        int lo = hex_nibble((unsigned char) src[0]);
+
+        if (lo >= 0)
+        {
+            dst[written++] = (unsigned char) ((*pending << 4) | lo);
+            start = 1;
+        }
+        else
+        {
+            skipped++;
+        }
+        *pending = -1;
+    }
+
+    written += scan_hex_decode(&dst[written], &src[start], count - start, &consumed, invalid);
+    consumed += start;
+
+    if (consumed < count)
+    {
+        *pending = hex_nibble((unsigned char) src[consumed]);
+    }
+
+    if (invalid != NULL)
+    {
+        *invalid += skipped;
+    }
+
+    return written;
+}
@@ -0,0 +1,51 @@
+/*
+ * tio - a serial device I/O tool
+ *
+ * Copyright (c) 2014-2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define SCAN_SET_SIZE_MAX 4
+
+enum scan_impl_t
+{
+    SCAN_IMPL_AUTO,
+    SCAN_IMPL_SCALAR,
+    SCAN_IMPL_SSE2,
+    SCAN_IMPL_AVX2,
+    SCAN_IMPL_NEON,
+    SCAN_IMPL_END,
+};
+
+typedef struct
+{
+    unsigned char chars[SCAN_SET_SIZE_MAX];
+    size_t count;
+} scan_set_t;
+
+void scan_set_init(scan_set_t *set, const char *chars, size_t count);
+size_t scan_chars(const scan_set_t *set, const char *buffer, size_t count);
+size_t scan_ctrl(const char *buffer, size_t count);
+size_t scan_hex_decode(unsigned char *dst, const char *src, size_t count, size_t *consumed, size_t *invalid);
+size_t scan_hex_decode_stream(int *pending, unsigned char *dst, const char *src, size_t count, size_t *invalid);
+bool scan_impl_select(enum scan_impl_t impl);
+const char *scan_impl_name(void);
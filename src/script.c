@@ -31,6 +31,7 @@
 #include "options.h"
 #include "tty.h"
 #include "xymodem.h"
+#include "sequence.h"
 #include "re.h"
 
 static int line_mask;
@@ -209,6 +210,54 @@ static int modem_send(lua_State *L)
     return 0;
 }
 
+// lua: send_file(file, chunk_size, chunk_delay)
+static int send_file(lua_State *L)
+{
+    const char *file = lua_tostring(L, 1);
+    lua_Integer chunk_size = lua_tointeger(L, 2);
+    lua_Integer chunk_delay = lua_tointeger(L, 3);
+    int ret;
+
+    if (file == NULL)
+    {
+        return 0;
+    }
+
+    if ((chunk_size < 0) || (chunk_delay < 0))
+    {
+        chunk_size = 0;
+        chunk_delay = 0;
+    }
+
+    tio_printf("Sending file '%s'", file);
+    ret = tty_send_file(file, chunk_size, chunk_delay);
+
+    lua_pushnumber(L, ret);
+
+    return 1;
+}
+
+// lua: line_sequence(sequence)
+static int line_sequence(lua_State *L)
+{
+    const char *sequence = lua_tostring(L, 1);
+
+    if (sequence == NULL)
+    {
+        return 0;
+    }
+
+    if(line_mask != 0)
+    {
+        tty_line_set(line_mask, line_state);
+        line_mask = 0;
+    }
+
+    lua_pushnumber(L, sequence_run(hPort, sequence));
+
+    return 1;
+}
+
 // lua: send(string)
 static int _send(lua_State *L)
 {
@@ -298,7 +347,7 @@ static int expect(lua_State *L)
     // Main loop to read and match
     while (true)
     {
-        ssize_t bytes_read = sp_blocking_read(hPort, &c, 1, timeout);
+        ssize_t bytes_read = tty_read(&c, 1, timeout);
         if (bytes_read > 0)
         {
             putchar(c);
@@ -355,6 +404,8 @@ static const struct luaL_Reg tio_lib[] =
     { "config_low", low},
     { "config_apply", config_apply},
     { "modem_send", modem_send},
+    { "send_file", send_file},
+    { "line_sequence", line_sequence},
     { "send", _send},
     { "expect", expect},
     { "exit", exit_},
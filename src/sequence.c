@@ -0,0 +1,309 @@
+/*
+ * tio - a serial device I/O tool
+ *
+ * Copyright (c) 2014-2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/* Modem line sequences, e.g. for resetting a target into its bootloader.
+ *
+ * A sequence is a comma separated list of steps, each either a line level
+ * such as "DTR=high" or "RTS=low", or a delay such as "100ms" or "500us".
+ * Line levels without a delay in between are applied at once. Steps are
+ * timed against the start of the sequence so errors don't accumulate. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "misc.h"
+#include "print.h"
+#include "sequence.h"
+
+#define SEQUENCE_MAX 16
+#define SEQUENCE_STEPS_MAX 32
+#define SEQUENCE_DELAY_MAX 10000000 // us
+
+#ifdef _WIN32
+#define SEQUENCE_SPIN_US 2000 // Sleep granularity is coarse
+#else
+#define SEQUENCE_SPIN_US 200
+#endif
+
+typedef struct
+{
+    uint64_t offset_us; // From start of sequence
+    int mask;
+    int asserted;
+} sequence_step_t;
+
+typedef struct
+{
+    char *name;
+    char *text;
+    sequence_step_t steps[SEQUENCE_STEPS_MAX];
+    int count;
+} sequence_t;
+
+static sequence_t sequences[SEQUENCE_MAX];
+static int sequence_count = 0;
+
+static int sequence_parse(sequence_t *sequence, const char *text)
+{
+    char *buffer = strdup(text);
+    char *token;
+    uint64_t offset = 0;
+    sequence_step_t *step = NULL;
+    int rc = 0;
+
+    sequence->count = 0;
+
+    for (token = strtok(buffer, ","); token != NULL; token = strtok(NULL, ","))
+    {
+        char keyname[4], level[5];
+        unsigned long value;
+        char unit[3] = "ms";
+        int line;
+
+        // Trim spaces
+        while (*token == ' ')
+        {
+            token++;
+        }
+
+        if (sscanf(token, "%3[A-Z]=%4[a-z]", keyname, level) == 2)
+        {
+            if (!strcmp(keyname, "DTR"))
+            {
+                line = SP_CTRL_DTR;
+            }
+            else if (!strcmp(keyname, "RTS"))
+            {
+                line = SP_CTRL_RTS;
+            }
+            else
+            {
+                break;
+            }
+
+            // Lines set at the same point in time share a step
+            if ((step == NULL) || (step->offset_us != offset))
+            {
+                if (sequence->count == SEQUENCE_STEPS_MAX)
+                {
+                    break;
+                }
+                step = &sequence->steps[sequence->count++];
+                step->offset_us = offset;
+                step->mask = 0;
+                step->asserted = 0;
+            }
+
+            // Electrically inverted, low level means asserted
+            step->mask |= line;
+            if (!strcmp(level, "low"))
+            {
+                step->asserted |= line;
+            }
+            else if (!strcmp(level, "high"))
+            {
+                step->asserted &= ~line;
+            }
+            else
+            {
+                break;
+            }
+        }
+        else if ((sscanf(token, "%lu%2s", &value, unit) >= 1) &&
+                 (!strcmp(unit, "ms") || !strcmp(unit, "us")))
+        {
+            offset += !strcmp(unit, "ms") ? value * 1000 : value;
+            if (offset > SEQUENCE_DELAY_MAX)
+            {
+                break;
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (token != NULL)
+    {
+        tio_warning_printf("Invalid line sequence step '%s'", token);
+        rc = -1;
+    }
+    else if (sequence->count == 0)
+    {
+        tio_warning_printf("Line sequence '%s' sets no lines", text);
+        rc = -1;
+    }
+
+    free(buffer);
+
+    return rc;
+}
+
+/* Define a named sequence, replacing one with the same name */
+int sequence_define(const char *name, const char *steps)
+{
+    sequence_t sequence;
+    int i;
+
+    if (sequence_parse(&sequence, steps) < 0)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < sequence_count; i++)
+    {
+        if (!strcmp(sequences[i].name, name))
+        {
+            free(sequences[i].name);
+            free(sequences[i].text);
+            break;
+        }
+    }
+
+    if (i == SEQUENCE_MAX)
+    {
+        tio_warning_printf("Too many line sequences");
+        return -1;
+    }
+
+    sequence.name = strdup(name);
+    sequence.text = strdup(steps);
+    sequences[i] = sequence;
+    if (i == sequence_count)
+    {
+        sequence_count++;
+    }
+
+    return 0;
+}
+
+void sequence_list(void)
+{
+    if (sequence_count == 0)
+    {
+        tio_printf(" No line sequences defined");
+        return;
+    }
+
+    for (int i = 0; i < sequence_count; i++)
+    {
+        tio_printf(" %s: %s", sequences[i].name, sequences[i].text);
+    }
+}
+
+static const char *sequence_step_name(const sequence_step_t *step)
+{
+    static char name[24];
+
+    name[0] = '\0';
+    if (step->mask & SP_CTRL_DTR)
+    {
+        strcat(name, (step->asserted & SP_CTRL_DTR) ? "DTR=low" : "DTR=high");
+    }
+    if (step->mask & SP_CTRL_RTS)
+    {
+        strcat(name, (step->mask & SP_CTRL_DTR) ? " " : "");
+        strcat(name, (step->asserted & SP_CTRL_RTS) ? "RTS=low" : "RTS=high");
+    }
+
+    return name;
+}
+
+/* Sleep until shortly before deadline, then spin for the rest */
+static uint64_t sequence_wait_until(uint64_t deadline)
+{
+    uint64_t now = monotonic_us();
+
+    if (deadline > now + SEQUENCE_SPIN_US)
+    {
+        delay((deadline - now - SEQUENCE_SPIN_US) / 1000);
+    }
+
+    while ((now = monotonic_us()) < deadline)
+    {
+    }
+
+    return now;
+}
+
+/* Run a named sequence or, if there is none by that name, the sequence given
+ * as text. Blocks for the duration of the sequence, received data keeps being
+ * collected by the reader thread meanwhile. Returns 0 on success. */
+int sequence_run(struct sp_port *port, const char *sequence)
+{
+    sequence_t adhoc;
+    sequence_t *s = NULL;
+    uint64_t actual[SEQUENCE_STEPS_MAX];
+    uint64_t start;
+    int64_t error_max = 0;
+    int i;
+
+    for (i = 0; i < sequence_count; i++)
+    {
+        if (!strcmp(sequences[i].name, sequence))
+        {
+            s = &sequences[i];
+            break;
+        }
+    }
+
+    if (s == NULL)
+    {
+        if (sequence_parse(&adhoc, sequence) < 0)
+        {
+            return -1;
+        }
+        s = &adhoc;
+    }
+
+    start = monotonic_us();
+    for (i = 0; i < s->count; i++)
+    {
+        sequence_wait_until(start + s->steps[i].offset_us);
+        if (sp_set_control_lines(port, s->steps[i].mask, s->steps[i].asserted) != SP_OK)
+        {
+            tio_warning_printf("Could not set lines (%s)", GetErrorMessage(GetLastError()));
+            return -1;
+        }
+        actual[i] = monotonic_us() - start;
+    }
+
+    // Report afterwards so printing doesn't disturb the timing
+    tio_printf("Line sequence timing:");
+    for (i = 0; i < s->count; i++)
+    {
+        int64_t error = (int64_t) actual[i] - (int64_t) s->steps[i].offset_us;
+
+        tio_printf(" %-17s at %8.3f ms (%+lld us)", sequence_step_name(&s->steps[i]),
+                   actual[i] / 1000.0, (long long) error);
+
+        if (llabs(error) > error_max)
+        {
+            error_max = llabs(error);
+        }
+    }
+    tio_printf(" Max deviation %lld us", (long long) error_max);
+
+    return 0;
+}
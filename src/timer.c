@@ -0,0 +1,262 @@
+/*
+ * tio - a serial device I/O tool
+ *
+ * Copyright (c) 2014-2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/* One-shot timers for work which must not block the main loop, such as
+ * ending a break or a line pulse. Timers are kept in a hashed timing wheel
+ * with 1 ms ticks, the main loop polls with timer_timeout() and calls
+ * timer_run() to fire what is due. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "misc.h"
+#include "timer.h"
+
+#define TIMER_MAX 32
+#define TIMER_WHEEL_SLOTS 64 // Power of two
+#define TIMER_TICK_US 1000
+
+typedef struct
+{
+    uint64_t deadline;
+    timer_callback_t callback;
+    void *arg;
+    int next;
+    unsigned int generation;
+    bool active;
+} timer_entry_t;
+
+static timer_entry_t timers[TIMER_MAX];
+static int wheel[TIMER_WHEEL_SLOTS];
+static uint64_t wheel_tick;
+static bool wheel_ready = false;
+
+static void timer_wheel_init(void)
+{
+    for (int i = 0; i < TIMER_WHEEL_SLOTS; i++)
+    {
+        wheel[i] = TIMER_INVALID;
+    }
+    wheel_tick = monotonic_us() / TIMER_TICK_US;
+    wheel_ready = true;
+}
+
+static inline int timer_slot(uint64_t deadline)
+{
+    return (deadline / TIMER_TICK_US) & (TIMER_WHEEL_SLOTS - 1);
+}
+
+/* Timer ids carry a generation so a stale id can't stop a reused timer,
+ * it wraps before reaching the sign bit so ids stay positive */
+static inline int timer_id(int index)
+{
+    return (int) ((timers[index].generation & 0x7fffff) << 8) | index;
+}
+
+static int timer_index(int id)
+{
+    int index = id & 0xff;
+
+    if ((id < 0) || (index >= TIMER_MAX) || !timers[index].active || (timer_id(index) != id))
+    {
+        return TIMER_INVALID;
+    }
+
+    return index;
+}
+
+static void timer_unlink(int index)
+{
+    int *link = &wheel[timer_slot(timers[index].deadline)];
+
+    while (*link != TIMER_INVALID)
+    {
+        if (*link == index)
+        {
+            *link = timers[index].next;
+            break;
+        }
+        link = &timers[*link].next;
+    }
+
+    timers[index].active = false;
+}
+
+/* Call callback with arg once ms milliseconds have passed. Returns timer id,
+ * or TIMER_INVALID if all timers are in use. */
+int timer_start(unsigned int ms, timer_callback_t callback, void *arg)
+{
+    int index;
+
+    if (!wheel_ready)
+    {
+        timer_wheel_init();
+    }
+
+    for (index = 0; index < TIMER_MAX; index++)
+    {
+        if (!timers[index].active)
+        {
+            break;
+        }
+    }
+    if (index == TIMER_MAX)
+    {
+        return TIMER_INVALID;
+    }
+
+    timer_entry_t *timer = &timers[index];
+    int slot;
+
+    timer->deadline = monotonic_us() + ms * 1000ULL;
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->generation++;
+    timer->active = true;
+
+    slot = timer_slot(timer->deadline);
+    timer->next = wheel[slot];
+    wheel[slot] = index;
+
+    return timer_id(index);
+}
+
+/* Cancel timer without calling its callback */
+void timer_stop(int id)
+{
+    int index = timer_index(id);
+
+    if (index != TIMER_INVALID)
+    {
+        timer_unlink(index);
+    }
+}
+
+bool timer_pending(int id)
+{
+    return timer_index(id) != TIMER_INVALID;
+}
+
+/* Return the time to wait [ms] for the next timer to be due, or -1 if no
+ * timer is running */
+int timer_timeout(void)
+{
+    uint64_t next = UINT64_MAX;
+
+    if (!wheel_ready)
+    {
+        return -1;
+    }
+
+    // No running timer is due before wheel_tick, so the first slot holding
+    // a timer for its own tick has the earliest one. Timers more than a
+    // round away are only found after walking the whole wheel.
+    for (uint64_t tick = wheel_tick; tick < wheel_tick + TIMER_WHEEL_SLOTS; tick++)
+    {
+        bool due = false;
+
+        for (int index = wheel[tick & (TIMER_WHEEL_SLOTS - 1)]; index != TIMER_INVALID; index = timers[index].next)
+        {
+            uint64_t deadline = timers[index].deadline;
+
+            if (deadline < next)
+            {
+                next = deadline;
+            }
+            if (deadline / TIMER_TICK_US <= tick)
+            {
+                due = true;
+            }
+        }
+
+        if (due)
+        {
+            break;
+        }
+    }
+
+    if (next == UINT64_MAX)
+    {
+        return -1;
+    }
+
+    return deadline_timeout(next);
+}
+
+/* Fire all timers which are due */
+void timer_run(void)
+{
+    uint64_t now, now_tick, tick;
+
+    if (!wheel_ready)
+    {
+        return;
+    }
+
+    now = monotonic_us();
+    now_tick = now / TIMER_TICK_US;
+
+    // After a long stall every slot is visited once
+    tick = wheel_tick;
+    if (now_tick - tick >= TIMER_WHEEL_SLOTS)
+    {
+        tick = now_tick - TIMER_WHEEL_SLOTS + 1;
+    }
+
+    for (; tick <= now_tick; tick++)
+    {
+        int *link = &wheel[tick & (TIMER_WHEEL_SLOTS - 1)];
+
+        while (*link != TIMER_INVALID)
+        {
+            timer_entry_t *timer = &timers[*link];
+
+            if (timer->deadline > now)
+            {
+                // Due in a later round of the wheel
+                link = &timer->next;
+                continue;
+            }
+
+            *link = timer->next;
+            timer->active = false;
+
+            // Callback may start new timers, so the slot is walked again
+            timer->callback(timer->arg);
+            link = &wheel[tick & (TIMER_WHEEL_SLOTS - 1)];
+        }
+    }
+
+    // Current tick may still get timers due later within it
+    wheel_tick = now_tick;
+}
+
+/* Wait for all running timers to fire, used before exit so e.g. a break or
+ * line pulse is completed */
+void timer_flush(void)
+{
+    int timeout;
+
+    while ((timeout = timer_timeout()) >= 0)
+    {
+        delay(timeout);
+        timer_run();
+    }
+}
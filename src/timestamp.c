@@ -29,85 +29,151 @@
 #include "print.h"
 #include "options.h"
 #include "timestamp.h"
+#include "misc.h"
 
-#define TIME_STRING_SIZE_MAX 24
+#define TIME_STRING_SIZE_MAX 32
 
-#ifndef timersub
-# define timersub(a, b, result)						      \
-  do {									      \
-    (result)->tv_sec = (a)->tv_sec - (b)->tv_sec;			      \
-    (result)->tv_usec = (a)->tv_usec - (b)->tv_usec;			      \
-    if ((result)->tv_usec < 0) {					      \
-      --(result)->tv_sec;						      \
-      (result)->tv_usec += 1000000;					      \
-    }									      \
-  } while (0)
-#endif	/* Misc.  */
+static char time_string[TIME_STRING_SIZE_MAX];
+static size_t prefix_length = 0;
+static enum timestamp_t prefix_format = TIMESTAMP_END;
+static long long prefix_seconds = 0;
 
-char *timestamp_current_time(void)
+/* Render the seconds part of the timestamp, e.g. "hh:mm:ss" */
+static size_t timestamp_render_prefix(enum timestamp_t format, long long seconds)
 {
-    static char time_string[TIME_STRING_SIZE_MAX];
-    static struct timeval tv, tv_now, tv_start, tv_previous;
-    static bool first = true;
+    time_t tt = seconds;
     struct tm *tm;
-    time_t tt;
-    size_t len;
 
-    // Get current time value
-    gettimeofday(&tv_now, NULL);
+    switch (format)
+    {
+        case TIMESTAMP_24HOUR:
+            tm = localtime(&tt);
+            return strftime(time_string, sizeof(time_string), "%H:%M:%S", tm);
+
+        case TIMESTAMP_ISO8601:
+            tm = localtime(&tt);
+            return strftime(time_string, sizeof(time_string), "%Y-%m-%dT%H:%M:%S", tm);
+
+        case TIMESTAMP_24HOUR_START:
+        case TIMESTAMP_24HOUR_DELTA:
+            // Elapsed time, hours wrap at 24 like the wall clock formats
+            return snprintf(time_string, sizeof(time_string), "%02lld:%02lld:%02lld",
+                            (seconds / 3600) % 24, (seconds / 60) % 60, seconds % 60);
+
+        default:
+            return 0;
+    }
+}
+
+/* Append ".sss" or ".ssssss" fraction to the cached prefix */
+static void timestamp_render_fraction(long usec)
+{
+    char *p = &time_string[prefix_length];
+    int digits = 6;
+
+    if (option.timestamp_resolution == TIMESTAMP_RESOLUTION_MS)
+    {
+        usec /= 1000;
+        digits = 3;
+    }
+
+    *p++ = '.';
+    for (int i = digits - 1; i >= 0; i--)
+    {
+        p[i] = '0' + (usec % 10);
+        usec /= 10;
+    }
+    p[digits] = 0;
+}
+
+/* Capture current time, may be called from any thread */
+void timestamp_capture(timestamp_stamp_t *stamp)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    stamp->realtime_us = (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+    stamp->monotonic_us = monotonic_us();
+}
+
+/* Format a previously captured time according to the timestamp options */
+char *timestamp_format(const timestamp_stamp_t *stamp)
+{
+    static uint64_t us_start, us_previous;
+    static bool first = true;
+    enum timestamp_t format = option.timestamp;
+    uint64_t us_now = stamp->monotonic_us, us_elapsed;
+    long long seconds;
+    long usec;
 
     if (first)
     {
-        tv_start = tv_now;
+        us_start = us_now;
+        us_previous = us_now;
         first = false;
     }
 
-    // Add formatted timestamp
-    switch (option.timestamp)
+    switch (format)
     {
         case TIMESTAMP_NONE:
         case TIMESTAMP_24HOUR:
             // "hh:mm:ss.sss" (24 hour format)
-            tv = tv_now;
-            tt = tv.tv_sec;
-            tm = localtime(&tt);
-            len = strftime(time_string, sizeof(time_string), "%H:%M:%S", tm);
+            format = TIMESTAMP_24HOUR;
+            // Fall through
+        case TIMESTAMP_ISO8601:
+            // "YYYY-MM-DDThh:mm:ss.sss" (ISO-8601)
+            seconds = stamp->realtime_us / 1000000;
+            usec = stamp->realtime_us % 1000000;
             break;
         case TIMESTAMP_24HOUR_START:
             // "hh:mm:ss.sss" (24 hour format relative to start time)
-            timersub(&tv_now, &tv_start, &tv);
-            tt = tv.tv_sec;
-            tm = gmtime(&tt);
-            len = strftime(time_string, sizeof(time_string), "%H:%M:%S", tm);
+            us_elapsed = (us_now > us_start) ? us_now - us_start : 0;
+            seconds = us_elapsed / 1000000;
+            usec = us_elapsed % 1000000;
             break;
         case TIMESTAMP_24HOUR_DELTA:
             // "hh:mm:ss.sss" (24 hour format relative to previous time stamp)
-            timersub(&tv_now, &tv_previous, &tv);
-            tt = tv.tv_sec;
-            tm = gmtime(&tt);
-            len = strftime(time_string, sizeof(time_string), "%H:%M:%S", tm);
-            break;
-        case TIMESTAMP_ISO8601:
-            // "YYYY-MM-DDThh:mm:ss.sss" (ISO-8601)
-            tv = tv_now;
-            tt = tv.tv_sec;
-            tm = localtime(&tt);
-            len = strftime(time_string, sizeof(time_string), "%Y-%m-%dT%H:%M:%S", tm);
+            // Stamps captured earlier than the previous one count as 0
+            us_elapsed = (us_now > us_previous) ? us_now - us_previous : 0;
+            seconds = us_elapsed / 1000000;
+            usec = us_elapsed % 1000000;
             break;
         default:
             return NULL;
     }
 
-    // Append milliseconds to all timestamps
-    if (len)
+    // Save previous time value for next run
+    if (us_now > us_previous)
     {
-        len = snprintf(time_string + len, TIME_STRING_SIZE_MAX - len, ".%03ld", (long)tv.tv_usec / 1000);
+        us_previous = us_now;
     }
 
-    // Save previous time value for next run
-    tv_previous = tv_now;
+    // Seconds part only changes once per second, reuse it until then
+    if ((format != prefix_format) || (seconds != prefix_seconds))
+    {
+        prefix_length = timestamp_render_prefix(format, seconds);
+        if ((prefix_length == 0) || (prefix_length + 8 > TIME_STRING_SIZE_MAX))
+        {
+            prefix_format = TIMESTAMP_END;
+            return NULL;
+        }
+        prefix_format = format;
+        prefix_seconds = seconds;
+    }
 
-    return (len < TIME_STRING_SIZE_MAX) ? time_string : NULL;
+    timestamp_render_fraction(usec);
+
+    return time_string;
+}
+
+char *timestamp_current_time(void)
+{
+    timestamp_stamp_t stamp;
+
+    timestamp_capture(&stamp);
+
+    return timestamp_format(&stamp);
 }
 
 const char* timestamp_state_to_string(enum timestamp_t timestamp)
@@ -140,6 +206,21 @@ const char* timestamp_state_to_string(enum timestamp_t timestamp)
     }
 }
 
+enum timestamp_resolution_t timestamp_resolution_option_parse(const char *arg)
+{
+    if (strcmp(arg, "ms") == 0)
+    {
+        return TIMESTAMP_RESOLUTION_MS;
+    }
+    else if (strcmp(arg, "us") == 0)
+    {
+        return TIMESTAMP_RESOLUTION_US;
+    }
+
+    tio_error_printf("Invalid timestamp resolution option");
+    exit(EXIT_FAILURE);
+}
+
 enum timestamp_t timestamp_option_parse(const char *arg)
 {
     enum timestamp_t timestamp = TIMESTAMP_24HOUR; // Default
@@ -21,6 +21,8 @@
 
 #pragma once
 
+#include <stdint.h>
+
 enum timestamp_t
 {
     TIMESTAMP_NONE,
@@ -31,6 +33,21 @@ enum timestamp_t
     TIMESTAMP_END,
 };
 
+enum timestamp_resolution_t
+{
+    TIMESTAMP_RESOLUTION_MS,
+    TIMESTAMP_RESOLUTION_US,
+};
+
+typedef struct
+{
+    uint64_t realtime_us;
+    uint64_t monotonic_us;
+} timestamp_stamp_t;
+
+void timestamp_capture(timestamp_stamp_t *stamp);
+char *timestamp_format(const timestamp_stamp_t *stamp);
 char *timestamp_current_time(void);
 const char* timestamp_state_to_string(enum timestamp_t timestamp);
 enum timestamp_t timestamp_option_parse(const char *arg);
+enum timestamp_resolution_t timestamp_resolution_option_parse(const char *arg);
@@ -19,6 +19,10 @@
  * 02110-1301, USA.
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -36,6 +40,10 @@
 #include <time.h>
 #include <dirent.h>
 #include <pthread.h>
+#ifndef _WIN32
+#include <sched.h>
+#include <termios.h>
+#endif
 #include "serialport.h"
 #include "configfile.h"
 #include "tty.h"
@@ -50,11 +58,39 @@
 #include "timestamp.h"
 #include "cpoll.h"
 #include "ring.h"
+#include "semaphore.h"
+#ifdef _WIN32
 #include "enumport.h"
+#endif
 #include "script.h"
 #include "xymodem.h"
+#include "scan.h"
+#include "hexdump.h"
+#include "re.h"
+#include "timer.h"
+#include "sequence.h"
+#ifdef _WIN32
+#include "mmap.h"
+#else
+#include <sys/mman.h>
+#endif
 
 #define LINE_SIZE_MAX 1000
+#define RX_RING_SIZE (1024*1024)
+#define TX_QUEUE_SIZE (64*1024)
+#define TX_OUTQ_LIMIT 4096
+#define LINE_SYNC_TIMEOUT 1000
+#define LINE_SYNC_TEXT_MAX 256
+#define FORWARD_CHUNK_SIZE (64*1024)
+#define RX_SERVICE_BUDGET (4*BUFSIZ)
+#define SEND_PROGRESS_INTERVAL 500 // ms
+#define BREAK_DURATION 100 // ms
+#define HEX_PROMPT_ERASE_DELAY 100 // ms
+#define PATH_SERIAL_DEVICES "/dev/serial/by-id/"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
 
 #define KEY_0 0x30
 #define KEY_1 0x31
@@ -70,6 +106,7 @@
 #define KEY_SHIFT_F 0x46
 #define KEY_G 0x67
 #define KEY_I 0x69
+#define KEY_K 0x6B
 #define KEY_L 0x6C
 #define KEY_SHIFT_L 0x4C
 #define KEY_M 0x6D
@@ -81,6 +118,7 @@
 #define KEY_T 0x74
 #define KEY_U 0x55
 #define KEY_V 0x76
+#define KEY_W 0x77
 #define KEY_X 0x78
 #define KEY_SHIFT_X 0x58
 #define KEY_Y 0x79
@@ -107,6 +145,23 @@ typedef struct
     bool reserved;
 } tty_line_config_t;
 
+typedef struct
+{
+    unsigned char xlate[256];   // Character translation
+    const char *expand[256];    // Replacement sequence of translated character (or NULL)
+    bool identity;              // Translation does not change any character
+} map_table_t;
+
+typedef enum
+{
+    POLL_ID_TTY,
+    POLL_ID_TTY_ERROR,
+    POLL_ID_TTY_TX,
+    POLL_ID_EXIT,
+    POLL_ID_STDIN,
+    POLL_ID_END,
+} poll_id_t;
+
 const char random_array[] =
 {
 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x28, 0x20, 0x28, 0x0A, 0x20,
@@ -128,13 +183,22 @@ bool map_ign_cr = false;
 
 char key_hit = 0xff;
 
-// static struct termios tio, tio_old, stdout_new, stdout_old, stdin_new, stdin_old;
+#ifndef _WIN32
+static struct termios stdout_new, stdout_old, stdin_new, stdin_old;
+#endif
 static unsigned long rx_total = 0, tx_total = 0;
-static __LONG32 connected = false;
+static volatile long connected = false;
 static void (*print)(char c);
+static void (*print_buffer)(const char *buffer, size_t count);
+/* Port handle is shared with the reader thread, which owns the receive
+ * side: reads and the RX event wait. The main thread only writes and
+ * changes settings. On Windows both sides use their own OVERLAPPED
+ * (read_ovl/wait_ovl vs write_ovl), so the port must be opened
+ * overlapped and the main thread must not read or flush input. */
 static struct sp_port *hPort;
 static struct sp_port_config* cfgPort, *cfgPort_old;
 static struct sp_event_set *sp_event = NULL;
+static struct sp_event_set *sp_tx_event = NULL;
 static bool map_i_ff_escc = false;
 static bool map_i_nl_crnl = false;
 static bool map_o_cr_nl = false;
@@ -143,17 +207,69 @@ static bool map_o_del_bs = false;
 static bool map_o_ltu = false;
 static bool map_o_nulbrk = false;
 static bool map_o_msblsb = false;
+static bool next_timestamp = false;
+static map_table_t map_rx, map_tx, map_tx_case;
+static scan_set_t rx_special;
 static char hex_chars[2];
 static unsigned char hex_char_index = 0;
-static char tty_buffer[BUFSIZ*2];
-static size_t tty_buffer_count = 0;
-static char *tty_buffer_write_ptr = tty_buffer;
+#ifdef _WIN32
 static pthread_t thread;
 static RING_Handle_t ring;
 static pthread_mutex_t mutex_input_ready = PTHREAD_MUTEX_INITIALIZER;
+#endif
 static char line[LINE_SIZE_MAX];
-static HANDLE ev_exit;
+static char line_buffer[BUFSIZ];
+static unsigned int line_index = 0;
+static char input_previous_char[2] = {};
+static SEM_Handle_t ev_exit;
+static POLL_Handle_t poll_set;
+static short poll_always_ready[POLL_ID_END];
+static pthread_t rx_thread;
+static RING_Handle_t rx_ring;
+static SEM_Handle_t ev_rx_stop, ev_rx_error;
+static volatile unsigned long rx_dropped = 0;
+static bool rx_thread_running = false;
+static unsigned long rx_dropped_reported = 0;
+static size_t rx_chunk_left = 0;
+static bool rx_idle_pending = false;
+static uint64_t rx_idle_deadline;
+static bool rx_gap_break = false;
+static char tx_queue[TX_QUEUE_SIZE];
+static size_t tx_head = 0, tx_count = 0;
+static bool tx_timer_armed = false, tx_waiting = false;
+static bool tx_break = false;
+static int break_timer = TIMER_INVALID;
+static int line_pulse_timer = TIMER_INVALID;
+static int line_pulse_mask;
+static int hex_erase_timer = TIMER_INVALID;
+static uint64_t tx_timer_deadline;
+static uint64_t tx_due;
+static unsigned long tx_paced_count = 0;
+static uint64_t tx_jitter_sum = 0, tx_jitter_max = 0;
+static bool tx_sync_wait = false;
+static uint64_t tx_sync_deadline;
+static char tx_sync_line[LINE_SIZE_MAX];
+static size_t tx_sync_line_length = 0;
+static unsigned long tx_sync_timeouts = 0;
+static size_t tx_sync_prefix[LINE_SIZE_MAX];
+static size_t rx_sync_match = 0;
+static struct regex_t *rx_sync_prompt = NULL;
+static int rx_sync_prompt_end = -1;
+static char rx_sync_text[LINE_SYNC_TEXT_MAX + 1];
+static size_t rx_sync_text_length = 0;
+static WAIT_HANDLE tx_waitable;
+static timestamp_stamp_t rx_chunk_stamp;
+
+/* Header preceding each chunk of received data in rx_ring */
+typedef struct
+{
+    uint32_t length;
+    timestamp_stamp_t stamp;
+} rx_chunk_t;
+
 
+static sub_command_t sub_command = SUBCOMMAND_NONE;
+static char command_previous_char = 0;
 
 static void optional_local_echo(char c)
 {
@@ -195,1082 +311,3221 @@ inline static unsigned char char_to_nibble(char c)
     }
 }
 
-void tty_sync()
+static unsigned char bit_reverse(unsigned char c)
 {
-    ssize_t count;
+    unsigned char r = 0;
 
-    while (tty_buffer_count > 0)
+    for (int i = 0; i < 8; ++i)
     {
-        count = sp_blocking_write(hPort, tty_buffer, tty_buffer_count, 0);
-        if (count < 0)
-        {
-            // Error
-            tio_debug_printf("Write error while flushing tty buffer (%s)", GetErrorMessage(GetLastError()));
-            break;
-        }
-        tty_buffer_count -= count;
-        sp_drain(hPort);
+        r |= ((1 << i) & c) ? (1 << (7 - i)) : 0;
     }
 
-    // Reset
-    tty_buffer_write_ptr = tty_buffer;
-    tty_buffer_count = 0;
+    return r;
 }
 
-ssize_t tty_write(const void *buffer, size_t count)
+static void map_table_reset(map_table_t *map)
 {
-    ssize_t retval = 0, bytes_written = 0;
-    size_t i;
-
-    if (map_o_ltu)
+    for (int c = 0; c < 256; c++)
     {
-        // Convert lower case to upper case
-        for (i = 0; i<count; i++)
-        {
-            *((unsigned char*)buffer+i) = toupper(*((unsigned char*)buffer+i));
-        }
+        map->xlate[c] = c;
+        map->expand[c] = NULL;
     }
+    map->identity = true;
+}
+
+static void map_apply(const map_table_t *map, char *dst, const void *src, size_t count)
+{
+    const unsigned char *s = src;
 
-    if (option.output_delay || option.output_line_delay)
+    for (size_t i = 0; i < count; i++)
     {
-        // Write byte by byte with output delay
-        for (i=0; i<count; i++)
-        {
-            retval = sp_blocking_write(hPort, buffer, 1, 0);
-            if (retval < 0)
-            {
-                // Error
-                tio_debug_printf("Write error (%s)", GetErrorMessage(GetLastError()));
-                break;
-            }
-            bytes_written += retval;
+        dst[i] = map->xlate[s[i]];
+    }
+}
 
-            if (option.output_line_delay && *(unsigned char*)buffer == '\n')
-            {
-                delay(option.output_line_delay);
-            }
+/* Compile map flags into per direction lookup tables. Must be called
+ * whenever one of the map_* flags changes. */
+static void map_compile(void)
+{
+    char special[SCAN_SET_SIZE_MAX];
+    size_t special_count = 0;
 
-            sp_drain(hPort);
+    map_table_reset(&map_rx);
+    map_table_reset(&map_tx);
+    map_table_reset(&map_tx_case);
 
-            if (option.output_delay)
-            {
-                delay(option.output_delay);
-            }
+    /* Input: bit order reversal disables the other input mappings */
+    if (map_o_msblsb)
+    {
+        for (int c = 0; c < 256; c++)
+        {
+            map_rx.xlate[c] = bit_reverse(c);
         }
+        map_rx.identity = false;
     }
     else
     {
-        // Force write of tty buffer if too full
-        if ((tty_buffer_count + count) > BUFSIZ)
+        if (map_i_nl_crnl)
         {
-            tty_sync(hPort);
+            map_rx.expand['\n'] = "\r\n";
+        }
+        if (map_i_ff_escc)
+        {
+            map_rx.expand['\f'] = "\ec";
         }
-
-        // Copy bytes to tty write buffer
-        memcpy(tty_buffer_write_ptr, buffer, count);
-        tty_buffer_write_ptr += count;
-        tty_buffer_count += count;
-        bytes_written = count;
     }
 
-    return bytes_written;
-}
-
-void *tty_stdin_input_thread(void *arg)
-{
-    UNUSED(arg);
-    char input_buffer[BUFSIZ];
-    DWORD byte_count;
-    HANDLE hInput;
-
-    // Get STDIN handle
-    hInput = GetStdHandle(STD_INPUT_HANDLE);
-
-    // Create FIFO
-    ring = RING_Init(0x8000);
-
-    // Signal that input pipe is ready
-    pthread_mutex_unlock(&mutex_input_ready);
-
-    // Input loop for stdin
-    while (1)
+    /* Newlines are always special on input, for timestamps */
+    special[special_count++] = '\n';
+    for (int c = 0; c < 256 && special_count < SCAN_SET_SIZE_MAX; c++)
     {
-        /* Input from stdin ready */
-        ReadConsoleA(hInput, input_buffer, BUFSIZ, &byte_count, NULL);
-        if (interactive_mode)
+        if (map_rx.expand[c] != NULL && c != '\n')
         {
-            static char previous_char = 0;
-            char input_char;
-
-            // Process quit and flush key command
-            for (int i = 0; i<byte_count; i++)
-            {
-                // first do key hit check for xmodem abort
-                if (!key_hit) {
-                    key_hit = input_buffer[i];
-                    byte_count--;
-                    memcpy(input_buffer+i, input_buffer+i+1, byte_count-i);
-                    continue;
-                }
-
-                input_char = input_buffer[i];
-
-                if (option.prefix_enabled && previous_char == option.prefix_code)
-                {
-                    if (input_char == option.prefix_code)
-                    {
-                        previous_char = 0;
-                        continue;
-                    }
-
-                    switch (input_char)
-                    {
-                        case KEY_Q:
-                            SetEvent(ev_exit);
-                            exit(EXIT_SUCCESS);
-                            break;
-                        case KEY_SHIFT_F:
-                            tio_printf("Flushed data I/O channels")
-                            sp_drain(hPort);
-                            break;
-                        default:
-                            break;
-                    }
-                }
-                previous_char = input_char;
-            }
+            special[special_count++] = c;
         }
+    }
+    scan_set_init(&rx_special, special, special_count);
 
-        // Write all bytes read to pipe
-        RING_Write_Blocking(ring, input_buffer, byte_count);
+    /* Output: translation happens before newline expansion */
+    if (map_o_del_bs)
+    {
+        map_tx.xlate[127] = '\b';
+        map_tx.identity = false;
+    }
+    if (map_o_cr_nl)
+    {
+        map_tx.xlate['\r'] = '\n';
+        map_tx.identity = false;
+    }
+    if (map_o_nl_crnl)
+    {
+        map_tx.expand['\n'] = "\r\n";
+        map_tx.expand['\r'] = "\r\n";
     }
 
-    SetEvent(ev_exit);
-    pthread_exit(0);
+    /* Output: case conversion is applied to everything written to tty */
+    if (map_o_ltu)
+    {
+        for (int c = 0; c < 256; c++)
+        {
+            map_tx_case.xlate[c] = toupper(c);
+        }
+        map_tx_case.identity = false;
+    }
 }
 
-void tty_input_thread_create(void)
+static void tty_poll_add(WAIT_HANDLE fd, short events, int id, const char *name)
 {
-    pthread_mutex_lock(&mutex_input_ready);
-
-    ev_exit = CreateEventA(NULL, TRUE, FALSE, NULL);
+    errno = 0;
+    if (POLL_Add(poll_set, fd, events, id) == 0)
+    {
+        return;
+    }
 
-    if (pthread_create(&thread, NULL, tty_stdin_input_thread, NULL) != 0) {
-        tio_error_printf("pthread_create() error");
-        exit(1);
+#ifdef __linux__
+    /* epoll refuses regular files and /dev/null, which poll() would always
+     * report ready, so do the same instead of never waking up for them */
+    if ((errno == EPERM) && (id != POLL_ID_TTY) && (id != POLL_ID_TTY_ERROR) && (id != POLL_ID_EXIT))
+    {
+        poll_always_ready[id] = events;
+        return;
     }
+#endif
+
+    tio_error_printf("Could not add %s to poll set (%s)", name, strerror(errno));
+    exit(EXIT_FAILURE);
 }
 
-void tty_input_thread_wait_ready(void)
+static void tty_poll_remove(WAIT_HANDLE fd, int id)
 {
-    pthread_mutex_lock(&mutex_input_ready);
+    if (poll_always_ready[id])
+    {
+        poll_always_ready[id] = 0;
+        return;
+    }
+
+    POLL_Remove(poll_set, fd);
 }
 
-static void handle_hex_prompt(char c)
+static void tty_tx_wait_set(bool enable)
 {
-    hex_chars[hex_char_index++] = c;
+    if (enable == tx_waiting)
+    {
+        return;
+    }
 
-    printf("%c", c);
-    print_tainted_set();
+    /* Only part of the poll set while there is something to send, so a hung
+     * up device does not keep waking up the main loop */
+    if (enable)
+    {
+        tty_poll_add(tx_waitable, POLL_OUT, POLL_ID_TTY_TX, "device");
+    }
+    else
+    {
+        tty_poll_remove(tx_waitable, POLL_ID_TTY_TX);
+    }
+    tx_waiting = enable;
+}
 
-    if (hex_char_index == 2)
+/* Queue bytes for transmission, returns number of bytes which fit */
+static size_t tty_tx_queue(const char *buffer, size_t count, bool map_case)
+{
+    size_t queued = 0;
+
+    while ((queued < count) && (tx_count < TX_QUEUE_SIZE))
     {
-        usleep(100*1000);
-        if (option.local_echo == false)
-        {
-        printf("\b \b");
-        printf("\b \b");
-        }
-        else
+        size_t tail = (tx_head + tx_count) % TX_QUEUE_SIZE;
+        size_t n = (tail >= tx_head) ? TX_QUEUE_SIZE - tail : tx_head - tail;
+
+        if (n > count - queued)
         {
-            printf(" ");
+            n = count - queued;
         }
 
-        unsigned char hex_value = char_to_nibble(hex_chars[0]) << 4 | (char_to_nibble(hex_chars[1]) & 0x0F);
-        hex_char_index = 0;
-
-        ssize_t status = tty_write(&hex_value, 1);
-        if (status < 0)
+        // Case conversion applies to everything written to tty
+        if (map_tx_case.identity || !map_case)
         {
-            tio_warning_printf("Could not write to tty device");
+            memcpy(&tx_queue[tail], &buffer[queued], n);
         }
         else
         {
-            tx_total++;
+            map_apply(&map_tx_case, &tx_queue[tail], &buffer[queued], n);
         }
+        tx_count += n;
+        queued += n;
     }
+
+    return queued;
 }
 
-void tty_line_set(int mask, int value)
+static bool tty_tx_paced(void)
 {
-    struct sp_port_config* config;
-    sp_new_config(&config);
-    sp_get_config(hPort, config);
-    if(mask & TIOCM_DTR) {
-        sp_set_config_dtr(config, (value & TIOCM_DTR) ? SP_DTR_ON : SP_DTR_OFF);
-        tio_printf("Setting DTR to %s", (value & TIOCM_DTR) ? "LOW" : "HIGH");
-    }
-    if(mask & TIOCM_RTS) {
-        sp_set_config_rts(config, (value & TIOCM_RTS) ? SP_RTS_ON : SP_RTS_OFF);
-        tio_printf("Setting RTS to %s", (value & TIOCM_RTS) ? "LOW" : "HIGH");
-    }
-    sp_set_config(hPort, config);
-    sp_free_config(config);
+    // Line delay only is a timeout when waiting for line sync
+    return (option.output_delay > 0) ||
+           ((option.output_line_delay > 0) && (option.output_line_sync == LINE_SYNC_NONE));
 }
 
-void tty_line_toggle(int mask)
+/* Resume writing at deadline [us] from the main loop timer */
+static void tty_tx_timer_arm(uint64_t deadline)
 {
-    struct sp_port_config* config;
-    sp_new_config(&config);
-    sp_get_config(hPort, config);
-    enum sp_dtr dtr;
-    enum sp_rts rts;
-    sp_get_config_dtr(config, &dtr);
-    sp_get_config_rts(config, &rts);
-    if(mask & TIOCM_DTR) {
-        sp_set_config_dtr(config, dtr == SP_DTR_OFF ? SP_DTR_ON : SP_DTR_OFF);
-        tio_printf("Setting DTR to %s", dtr == SP_DTR_OFF ? "LOW" : "HIGH");
-    }
-    if(mask & TIOCM_RTS) {
-        sp_set_config_rts(config, rts == SP_RTS_OFF ? SP_RTS_ON : SP_RTS_OFF);
-        tio_printf("Setting RTS to %s", rts == SP_RTS_OFF ? "LOW" : "HIGH");
-    }
-    sp_set_config(hPort, config);
-    sp_free_config(config);
+    tx_timer_deadline = deadline;
+    tx_timer_armed = true;
 }
 
-static void tty_line_pulse(int mask, unsigned int duration)
+/* Pause writing until the driver output queue went down to target bytes */
+static void tty_tx_throttle(int outq, int target)
 {
-    tty_line_toggle(mask);
+    unsigned int bits = 1 + option.databits + option.stopbits + (strcmp(option.parity, "none") ? 1 : 0);
+    uint64_t excess = outq - target;
+    uint64_t wait_us = 1000;
 
-    if (duration > 0)
+    if (option.baudrate > 0)
     {
-        tio_printf("Waiting %d ms", duration);
-        delay(duration);
+        wait_us += excess * bits * 1000000ULL / option.baudrate;
     }
 
-    tty_line_toggle(mask);
+    tty_tx_timer_arm(monotonic_us() + wait_us);
 }
 
-static void tty_line_poke(int mask, tty_line_mode_t mode, unsigned int duration)
+/* Paced transmission sends one byte at a time on an absolute schedule, so
+ * wakeup latency does not add up over a long paste. Returns true if the
+ * next byte is due. */
+static bool tty_tx_pace(void)
 {
-    switch (mode)
+    if (monotonic_us() < tx_due)
     {
-        case LINE_TOGGLE:
-            tty_line_toggle(mask);
-            break;
-
-        case LINE_PULSE:
-            tty_line_pulse(mask, duration);
-            break;
+        tty_tx_timer_arm(tx_due);
+        return false;
     }
+
+    return true;
 }
 
-static int tio_readln(void)
+/* Byte c was sent, schedule the following one */
+static void tty_tx_pace_next(char c)
 {
-    char *p = line;
+    uint64_t gap = option.output_delay * 1000ULL;
+    uint64_t now = monotonic_us();
 
-    /* Read line, accept BS and DEL as rubout characters */
-    for (p = line ; p < &line[LINE_SIZE_MAX-1]; )
+    // Record how late the byte went out compared to its schedule
+    tx_jitter_sum += now - tx_due;
+    if ((now - tx_due) > tx_jitter_max)
     {
-        if (RING_Read_Blocking(ring, p, 1) == 0)
-        {
-            if (*p == 0x08 || *p == 0x7f)
-            {
-                if (p > line )
-                {
-                    write(STDOUT_FILENO, "\b \b", 3);
-                    p--;
-                }
-                continue;
-            }
-            write(STDOUT_FILENO, p, 1);
-            if (*p == '\r') break;
-            p++;
-        }
+        tx_jitter_max = now - tx_due;
     }
-    *p = 0;
-    return (p - line);
-}
+    tx_paced_count++;
 
-void tty_output_mode_set(output_mode_t mode)
-{
-    switch (mode)
+    if (option.output_line_delay && (c == '\n') && (option.output_line_sync == LINE_SYNC_NONE))
     {
-        case OUTPUT_MODE_NORMAL:
-            print = print_normal;
-            break;
+        gap += option.output_line_delay * 1000ULL;
+    }
 
-        case OUTPUT_MODE_HEX:
-            print = print_hex;
-            break;
+    tx_due += gap;
 
-        case OUTPUT_MODE_END:
-            break;
+    // Too far behind, resynchronize instead of sending a burst
+    if (tx_due + gap < now)
+    {
+        tx_due = now;
     }
 }
 
-void handle_command_sequence(char input_char, char *output_char, bool *forward)
+static int tty_tx_service(void);
+
+static bool is_line_end(char c)
 {
-    char unused_char;
-    bool unused_bool;
-    static tty_line_mode_t line_mode;
-    static sub_command_t sub_command = SUBCOMMAND_NONE;
-    static char previous_char = 0;
+    return (c == '\r') || (c == '\n');
+}
 
-    /* Ignore unused arguments */
-    if (output_char == NULL)
+/* In line sync mode writes stop after a line ending, a "\r\n" pair counts
+ * as one line ending. Returns number of bytes to write. */
+static size_t tty_tx_sync_limit(const char *data, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
     {
-        output_char = &unused_char;
+        if (is_line_end(data[i]))
+        {
+            if ((data[i] == '\r') && (i + 1 < count) && (data[i + 1] == '\n'))
+            {
+                i++;
+            }
+            return i + 1;
+        }
     }
 
-    if (forward == NULL)
-    {
-        forward = &unused_bool;
-    }
+    return count;
+}
 
-    // Handle tty line toggle and pulse action
-    if (sub_command)
+/* Keep track of the sent line, a line ending starts waiting for the device */
+static void tty_tx_sync_sent(const char *data, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
     {
-        *forward = false;
+        if (tx_sync_wait)
+        {
+            // Rest of a "\r\n" pair
+            continue;
+        }
 
-        switch (sub_command)
+        if (is_line_end(data[i]))
         {
-            case SUBCOMMAND_NONE:
-                break;
+            int timeout = option.output_line_delay ? option.output_line_delay : LINE_SYNC_TIMEOUT;
 
-            case SUBCOMMAND_LINE_TOGGLE:
-            case SUBCOMMAND_LINE_PULSE:
-        switch (input_char)
+            tx_sync_deadline = monotonic_us() + timeout * 1000ULL;
+            tx_sync_wait = true;
+            rx_sync_text_length = 0;
+        }
+        else if (tx_sync_line_length < sizeof(tx_sync_line))
         {
-            case KEY_0:
-                tty_line_poke(TIOCM_DTR, line_mode, option.dtr_pulse_duration);
-                break;
-            case KEY_1:
-                tty_line_poke(TIOCM_RTS, line_mode, option.rts_pulse_duration);
-                break;
-            case KEY_2:
-                tty_line_poke(TIOCM_DTR | TIOCM_RTS, line_mode, option.pulse_duration);
-                break;
-            default:
-                tio_warning_printf("Invalid line number");
-                break;
+            size_t q = tx_sync_line_length++;
+            size_t k = q ? tx_sync_prefix[q - 1] : 0;
+
+            // Longest proper prefix which is also a suffix, for the echo matcher
+            tx_sync_line[q] = data[i];
+            while ((k > 0) && (tx_sync_line[q] != tx_sync_line[k]))
+            {
+                k = tx_sync_prefix[k - 1];
+            }
+            if ((q > 0) && (tx_sync_line[q] == tx_sync_line[k]))
+            {
+                k++;
+            }
+            tx_sync_prefix[q] = k;
         }
-                break;
+    }
+}
 
-            case SUBCOMMAND_XMODEM:
-                switch (input_char)
-                {
-                    case KEY_0:
-                        tio_printf("Send file with XMODEM-1K");
-                        tio_printf_raw("Enter file name: ");
-                        if (tio_readln())
-                        {
-                            tio_printf("Sending file '%s'  ", line);
-                            tio_printf("Press any key to abort transfer");
-                            tio_printf("%s", xymodem_send(hPort, line, XMODEM_1K) < 0 ? "Aborted" : "Done");
-                        }
-                        break;
+/* Device is ready for the next line */
+static void tty_tx_sync_done(void)
+{
+    tx_sync_wait = false;
+    tx_sync_line_length = 0;
+    rx_sync_match = 0;
+}
 
-                    case KEY_1:
-                        tio_printf("Send file with XMODEM-CRC");
-                        tio_printf_raw("Enter file name: ");
-                        if (tio_readln())
-                        {
-                            tio_printf("Sending file '%s'  ", line);
-                            tio_printf("Press any key to abort transfer");
-                            tio_printf("%s", xymodem_send(hPort, line, XMODEM_CRC) < 0 ? "Aborted" : "Done");
-                        }
-                        break;
-                }
-                break;
-        }
+/* Count the backslashes right before pattern[pos] */
+static size_t regex_escapes(const char *pattern, size_t pos)
+{
+    size_t n = 0;
 
-        sub_command = SUBCOMMAND_NONE;
+    while ((n < pos) && (pattern[pos - 1 - n] == '\\'))
+    {
+        n++;
+    }
+
+    return n;
+}
+
+/* Return the character a match of pattern has to end with, or -1 if that
+ * can't be told from the pattern */
+static int regex_last_char(const char *pattern)
+{
+    size_t length = strlen(pattern);
+    char c;
+
+    // A match at the start moves when the kept tail is shifted
+    if (pattern[0] == '^')
+    {
+        return -1;
+    }
+
+    // End anchor, unless escaped
+    if ((length > 0) && (pattern[length - 1] == '$') && ((regex_escapes(pattern, length - 1) % 2) == 0))
+    {
+        length--;
+    }
+    if (length == 0)
+    {
+        return -1;
+    }
+
+    c = pattern[length - 1];
+    if ((regex_escapes(pattern, length - 1) % 2) == 1)
+    {
+        // Escaped classes such as \d match several characters
+        return (strchr("dDwWsS", c) != NULL) ? -1 : (unsigned char) c;
+    }
+
+    return (strchr("*+?.])}|$^\\", c) != NULL) ? -1 : (unsigned char) c;
+}
+
+/* Prompt pattern is compiled once. tiny-regex-c keeps it in static storage
+ * which is reused by script expect(), so it is compiled again after a
+ * script ran. */
+static void tty_tx_sync_prompt_compile(void)
+{
+    if (option.output_line_sync != LINE_SYNC_PROMPT)
+    {
         return;
     }
 
-    /* Handle escape key commands */
-    if (option.prefix_enabled && previous_char == option.prefix_code)
+    rx_sync_prompt = re_compile(option.output_line_prompt);
+    if (rx_sync_prompt == NULL)
     {
-        /* Do not forward input char to output by default */
-        *forward = false;
+        tio_error_printf("Invalid output line prompt");
+        exit(EXIT_FAILURE);
+    }
+    rx_sync_prompt_end = regex_last_char(option.output_line_prompt);
+}
 
-        /* Handle special double prefix key input case */
-        if (input_char == option.prefix_code)
-        {
-            /* Forward prefix character to tty */
-            *output_char = option.prefix_code;
-            *forward = true;
-            previous_char = 0;
-            return;
-        }
+/* Look for the echo of the sent line or the prompt in received data */
+static void tty_tx_sync_rx(const char *data, size_t count)
+{
+    bool synced = false;
 
-        // Handle commands
-        switch (input_char)
+    if (option.output_line_sync == LINE_SYNC_ECHO)
+    {
+        for (size_t i = 0; (i < count) && !synced; i++)
         {
-            case KEY_QUESTION:
-                tio_printf("Key commands:");
-                tio_printf(" ctrl-%c ?       List available key commands", option.prefix_key);
-                tio_printf(" ctrl-%c b       Send break", option.prefix_key);
-                tio_printf(" ctrl-%c c       Show configuration", option.prefix_key);
-                tio_printf(" ctrl-%c e       Toggle local echo mode", option.prefix_key);
-                tio_printf(" ctrl-%c f       Toggle log to file", option.prefix_key);
-                tio_printf(" ctrl-%c F       Flush data I/O buffers", option.prefix_key);
-                tio_printf(" ctrl-%c g       Toggle serial port line", option.prefix_key);
-                tio_printf(" ctrl-%c i       Toggle input mode", option.prefix_key);
-                tio_printf(" ctrl-%c l       Clear screen", option.prefix_key);
-                tio_printf(" ctrl-%c L       Show line states", option.prefix_key);
-                tio_printf(" ctrl-%c m       Toggle MSB to LSB bit order", option.prefix_key);
-                tio_printf(" ctrl-%c o       Toggle output mode", option.prefix_key);
-                tio_printf(" ctrl-%c p       Pulse serial port line", option.prefix_key);
-                tio_printf(" ctrl-%c q       Quit", option.prefix_key);
-                tio_printf(" ctrl-%c r       Run script", option.prefix_key);
-                tio_printf(" ctrl-%c s       Show statistics", option.prefix_key);
-                tio_printf(" ctrl-%c t       Toggle line timestamp mode", option.prefix_key);
-                tio_printf(" ctrl-%c U       Toggle conversion to uppercase on output", option.prefix_key);
-                tio_printf(" ctrl-%c v       Show version", option.prefix_key);
-                tio_printf(" ctrl-%c x       Send file via Xmodem", option.prefix_key);
-                tio_printf(" ctrl-%c X       Send file via Xmodem-CRC", option.prefix_key);
-                tio_printf(" ctrl-%c y       Send file via Ymodem", option.prefix_key);
-                tio_printf(" ctrl-%c ctrl-%c  Send ctrl-%c character", option.prefix_key, option.prefix_key, option.prefix_key);
-                break;
+            size_t k = rx_sync_match;
 
-            case KEY_SHIFT_L:
+            if (k == tx_sync_line_length)
             {
-                enum sp_signal signal;
-                if (sp_get_signals(hPort, &signal) < 0)
+                // Whole line echoed, only the line ending right after it completes it
+                if (tx_sync_wait && is_line_end(data[i]))
                 {
-                    tio_warning_printf("Could not get line state (%s)", GetErrorMessage(GetLastError()));
+                    synced = true;
                     break;
                 }
-                struct sp_port_config* config;
-                sp_new_config(&config);
-                sp_get_config(hPort, config);
-                enum sp_dtr dtr;
-                enum sp_rts rts;
-                enum sp_cts cts;
-                enum sp_dsr dsr;
-                sp_get_config_dtr(config,&dtr);
-                sp_get_config_rts(config,&rts);
-                sp_get_config_cts(config,&cts);
-                sp_get_config_dsr(config,&dsr);
-                sp_free_config(config);
-
-                tio_printf("Line states:");
-                tio_printf(" DTR: %s", (dtr == SP_DTR_OFF) ? "HIGH" : "LOW");
-                tio_printf(" RTS: %s", (rts == SP_RTS_OFF) ? "HIGH" : "LOW");
-                tio_printf(" CTS: %s", (signal & SP_SIG_CTS) ? "LOW" : "HIGH");
-                tio_printf(" DSR: %s", (signal & SP_SIG_DSR) ? "LOW" : "HIGH");
-                tio_printf(" DCD: %s", (signal & SP_SIG_DCD) ? "LOW" : "HIGH");
-                tio_printf(" RI : %s", (signal & SP_SIG_RI) ? "LOW" : "HIGH");
-                break;
+                k = k ? tx_sync_prefix[k - 1] : 0;
             }
-            case KEY_F:
-                if (option.log)
-                {
-                    log_close();
-                    option.log = false;
-                }
-                else
-                {
-                    if (log_open(option.log_filename) == 0)
-                    {
-                        option.log = true;
-                    }
-                }
-                tio_printf("Switched log to file %s", option.log ? "on" : "off");
-                break;
 
-            case KEY_SHIFT_F:
-                break;
+            // Fall back to the longest echoed part which can still be continued
+            while ((k > 0) && (data[i] != tx_sync_line[k]))
+            {
+                k = tx_sync_prefix[k - 1];
+            }
+            if ((k < tx_sync_line_length) && (data[i] == tx_sync_line[k]))
+            {
+                k++;
+            }
+            rx_sync_match = k;
+        }
+    }
+    else if ((option.output_line_sync == LINE_SYNC_PROMPT) && tx_sync_wait)
+    {
+        // Keep the tail of what was received since the line was sent
+        if (count >= LINE_SYNC_TEXT_MAX)
+        {
+            memcpy(rx_sync_text, &data[count - LINE_SYNC_TEXT_MAX], LINE_SYNC_TEXT_MAX);
+            rx_sync_text_length = LINE_SYNC_TEXT_MAX;
+        }
+        else
+        {
+            if (rx_sync_text_length + count > LINE_SYNC_TEXT_MAX)
+            {
+                size_t drop = rx_sync_text_length + count - LINE_SYNC_TEXT_MAX;
+                memmove(rx_sync_text, &rx_sync_text[drop], rx_sync_text_length - drop);
+                rx_sync_text_length -= drop;
+            }
+            memcpy(&rx_sync_text[rx_sync_text_length], data, count);
+            rx_sync_text_length += count;
+        }
+        rx_sync_text[rx_sync_text_length] = '\0';
 
-            case KEY_G:
-                tio_printf("Please enter which serial line number to toggle:");
-                tio_printf(" DTR        (0)");
-                tio_printf(" RTS        (1)");
-                tio_printf(" DTR+RTS    (2)");
-                line_mode = LINE_TOGGLE;
-                // Process next input character as part of the line toggle step
-                sub_command = SUBCOMMAND_LINE_TOGGLE;
-                break;
+        // A new match has to end in this chunk
+        if ((rx_sync_prompt_end < 0) || (memchr(data, rx_sync_prompt_end, count) != NULL))
+        {
+            int length = 0;
+            synced = (re_matchp(rx_sync_prompt, rx_sync_text, &length) >= 0);
+        }
+    }
 
-            case KEY_P:
-                tio_printf("Please enter which serial line number to pulse:");
-                tio_printf(" DTR        (0)");
-                tio_printf(" RTS        (1)");
-                tio_printf(" DTR+RTS    (2)");
-                line_mode = LINE_PULSE;
-                // Process next input character as part of the line pulse step
-                sub_command = SUBCOMMAND_LINE_PULSE;
-                break;
+    if (synced && tx_sync_wait)
+    {
+        tty_tx_sync_done();
 
-            case KEY_B:
-                sp_start_break(hPort);
-                delay(100);
-                sp_end_break(hPort);
-                break;
+        // Cancel fallback timeout and continue with the next line
+        tx_timer_armed = false;
+        tty_tx_service();
+    }
+}
 
-            case KEY_C:
-                tio_printf("Configuration:");
-                options_print();
-                config_file_print();
-                break;
+/* Hand queued bytes over to the driver without blocking. At most
+ * TX_OUTQ_LIMIT bytes are kept in the driver output queue, the rest waits
+ * here so a drain, break or exit never waits for a huge driver buffer. */
+static int tty_tx_service(void)
+{
+    while ((tx_count > 0) && !tx_timer_armed && !tx_break)
+    {
+        // Queue wraps around, write its two segments in turn
+        size_t n = TX_QUEUE_SIZE - tx_head;
+        int outq;
+        ssize_t written;
 
-            case KEY_E:
-                option.local_echo = !option.local_echo;
-                tio_printf("Switched local echo %s", option.local_echo ? "on" : "off");
-                break;
+        if (n > tx_count)
+        {
+            n = tx_count;
+        }
 
-            case KEY_I:
-                option.input_mode += 1;
-                switch (option.input_mode)
+        if (option.output_line_sync != LINE_SYNC_NONE)
+        {
+            if (tx_sync_wait)
+            {
+                if (monotonic_us() < tx_sync_deadline)
                 {
-                    case INPUT_MODE_NORMAL:
-                        break;
-                /* Toggle hexadecimal printing mode */
-                    case INPUT_MODE_HEX:
-                        option.input_mode = INPUT_MODE_HEX;
-                        tio_printf("Switched to hex input mode");
-                        break;
+                    // Wait for echo or prompt, line delay is the fallback
+                    tty_tx_timer_arm(tx_sync_deadline);
+                    break;
+                }
+                tx_sync_timeouts++;
+                tty_tx_sync_done();
+            }
+            n = tty_tx_sync_limit(&tx_queue[tx_head], n);
+        }
 
-                    case INPUT_MODE_LINE:
-                        option.input_mode = INPUT_MODE_LINE;
-                        tio_printf("Switched to line input mode");
-                        break;
+        outq = sp_output_waiting(hPort);
 
-                    case INPUT_MODE_END:
-                        option.input_mode = INPUT_MODE_NORMAL;
-                        tio_printf("Switched to normal input mode");
-                        break;
-                }
+        if (tty_tx_paced())
+        {
+            // Previous byte must have left the driver before the next one is due
+            if (outq > 0)
+            {
+                tty_tx_throttle(outq, 0);
                 break;
-
+            }
+            if (!tty_tx_pace())
+            {
+                break;
+            }
+            n = 1;
+        }
+        else if (outq >= TX_OUTQ_LIMIT)
+        {
+            tty_tx_throttle(outq, TX_OUTQ_LIMIT / 2);
+            break;
+        }
+        if ((outq >= 0) && (n > (size_t) (TX_OUTQ_LIMIT - outq)))
+        {
+            n = TX_OUTQ_LIMIT - outq;
+        }
+
+        written = sp_nonblocking_write(hPort, &tx_queue[tx_head], n);
+        if (written < 0)
+        {
+            // Device is likely gone, queued data can't be sent anymore
+            tio_debug_printf("Write error (%s)", GetErrorMessage(GetLastError()));
+            tx_count = 0;
+            tty_tx_wait_set(false);
+            return -1;
+        }
+
+        if (tty_tx_paced() && (written > 0))
+        {
+            tty_tx_pace_next(tx_queue[tx_head]);
+        }
+
+        if (option.output_line_sync != LINE_SYNC_NONE)
+        {
+            tty_tx_sync_sent(&tx_queue[tx_head], written);
+        }
+
+        tx_head = (tx_head + written) % TX_QUEUE_SIZE;
+        tx_count -= written;
+
+        if ((size_t) written < n)
+        {
+            // Driver is full, continue when it is ready for more
+            break;
+        }
+    }
+
+    tty_tx_wait_set((tx_count > 0) && !tx_timer_armed && !tx_break);
+
+    return 0;
+}
+
+/* Resume writing when throttling ends and return the time to wait [ms] for
+ * it, or -1 if not throttled. */
+static int tty_tx_timeout(void)
+{
+    if (!tx_timer_armed)
+    {
+        return -1;
+    }
+
+    if (monotonic_us() >= tx_timer_deadline)
+    {
+        tx_timer_armed = false;
+        tty_tx_service();
+        if (!tx_timer_armed)
+        {
+            return -1;
+        }
+    }
+
+    return deadline_timeout(tx_timer_deadline);
+}
+
+/* Block until some queued data could be handed over to the driver */
+static int tty_tx_wait(void)
+{
+    pollfd_t fds[1] = { { .fd = tx_waitable, .events = POLL_OUT } };
+    int timeout = tty_tx_timeout();
+
+    if (tx_break)
+    {
+        // Queued data goes out once the break ends
+        delay(timer_timeout());
+        timer_run();
+        return 0;
+    }
+
+    if (tx_count == 0)
+    {
+        return 0;
+    }
+
+    if (tx_timer_armed)
+    {
+        delay(timeout);
+        return 0;
+    }
+
+    if (poll(fds, 1, -1) < 0)
+    {
+        return -1;
+    }
+
+    return tty_tx_service();
+}
+
+/* Hand all queued data over to the driver */
+static int tty_tx_flush(void)
+{
+    if (tty_tx_service() < 0)
+    {
+        return -1;
+    }
+
+    while ((tx_count > 0) || tx_break)
+    {
+        if (tty_tx_wait() < 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Bytes written but not transmitted yet, either queued or in the driver */
+size_t tty_tx_pending(void)
+{
+    int outq = connected ? sp_output_waiting(hPort) : 0;
+
+    return tx_count + ((outq > 0) ? outq : 0);
+}
+
+/* Wait until all written data is physically transmitted. Only done on
+ * explicit request, e.g. before a break, a file transfer or on exit. */
+void tty_drain(void)
+{
+    if (tty_tx_flush() == 0)
+    {
+        sp_drain(hPort);
+    }
+}
+
+/* Start transmission of queued data, returns without waiting */
+void tty_sync()
+{
+    tty_tx_service();
+}
+
+static void tty_break_end(void *arg)
+{
+    UNUSED(arg);
+
+    break_timer = TIMER_INVALID;
+    sp_end_break(hPort);
+    tx_break = false;
+
+    // Continue with data written during the break
+    tty_tx_service();
+}
+
+/* Send break without blocking the main loop. Data written meanwhile is held
+ * back until the break ends. */
+static void tty_break(void)
+{
+    if (tx_break && (tx_count == 0))
+    {
+        // Nothing to send in between, extend the running break
+        timer_stop(break_timer);
+    }
+    else
+    {
+        // Waits for a running break and the data queued after it
+        tty_drain();
+        sp_start_break(hPort);
+        tx_break = true;
+    }
+
+    break_timer = timer_start(BREAK_DURATION, tty_break_end, NULL);
+    if (break_timer == TIMER_INVALID)
+    {
+        delay(BREAK_DURATION);
+        tty_break_end(NULL);
+    }
+}
+
+ssize_t tty_write(const void *buffer, size_t count)
+{
+    const char *data = buffer;
+    size_t bytes_written = 0;
+
+    // Paced transmission starts over after being idle
+    if (tty_tx_paced() && (tx_count == 0) && (tx_due < monotonic_us()))
+    {
+        tx_due = monotonic_us();
+    }
+
+    while (bytes_written < count)
+    {
+        bytes_written += tty_tx_queue(&data[bytes_written], count - bytes_written, true);
+        if (bytes_written == count)
+        {
+            break;
+        }
+
+        // Queue is full, hold the caller back until the device catches up
+        if ((tty_tx_service() < 0) || ((tx_count == TX_QUEUE_SIZE) && (tty_tx_wait() < 0)))
+        {
+            return -1;
+        }
+    }
+
+    return bytes_written;
+}
+
+#ifdef _WIN32
+void *tty_stdin_input_thread(void *arg)
+{
+    UNUSED(arg);
+    char *input_buffer;
+    uint32_t room;
+    DWORD byte_count;
+    HANDLE hInput;
+
+    // Get STDIN handle
+    hInput = GetStdHandle(STD_INPUT_HANDLE);
+
+    // Create FIFO
+    ring = RING_Init_Mirror(0x10000);
+    if (ring == NULL)
+    {
+        ring = RING_Init_SPSC(0x8000);
+    }
+
+    pollfd_t fds = { .fd = RING_GetWaitable(ring, RING_Free), .events = POLL_IN };
+
+    // Signal that input pipe is ready
+    pthread_mutex_unlock(&mutex_input_ready);
+
+    // Input loop for stdin
+    while (1)
+    {
+        // Console input is read straight into the pipe
+        while ((room = RING_WriteReserve(ring, (void **) &input_buffer)) == 0)
+        {
+            poll(&fds, 1, -1);
+        }
+
+        /* Input from stdin ready */
+        ReadConsoleA(hInput, input_buffer, MIN(room, BUFSIZ), &byte_count, NULL);
+        if (interactive_mode)
+        {
+            static char previous_char = 0;
+            char input_char;
+
+            // Process quit and flush key command
+            for (int i = 0; i<byte_count; i++)
+            {
+                // first do key hit check for xmodem abort
+                if (!key_hit) {
+                    key_hit = input_buffer[i];
+                    byte_count--;
+                    memmove(input_buffer+i, input_buffer+i+1, byte_count-i);
+                    continue;
+                }
+
+                input_char = input_buffer[i];
+
+                if (option.prefix_enabled && previous_char == option.prefix_code)
+                {
+                    if (input_char == option.prefix_code)
+                    {
+                        previous_char = 0;
+                        continue;
+                    }
+
+                    switch (input_char)
+                    {
+                        case KEY_Q:
+                            SEM_Give(ev_exit);
+                            exit(EXIT_SUCCESS);
+                            break;
+                        case KEY_SHIFT_F:
+                            tio_printf("Flushed data I/O channels")
+                            sp_drain(hPort);
+                            break;
+                        default:
+                            break;
+                    }
+                }
+                previous_char = input_char;
+            }
+        }
+
+        // Hand all bytes read over to the pipe
+        RING_WriteCommit(ring, byte_count);
+    }
+
+    SEM_Give(ev_exit);
+    pthread_exit(0);
+}
+#endif
+
+static WAIT_HANDLE stdin_waitable(void)
+{
+#ifdef _WIN32
+    return RING_GetWaitable(ring, RING_Available);
+#else
+    return STDIN_FILENO;
+#endif
+}
+
+static ssize_t stdin_read(void *buffer, size_t count)
+{
+#ifdef _WIN32
+    return RING_Read(ring, buffer, count);
+#else
+    return read(STDIN_FILENO, buffer, count);
+#endif
+}
+
+static int stdin_read_blocking(char *c)
+{
+#ifdef _WIN32
+    return RING_Read_Blocking(ring, c, 1);
+#else
+    return (read(STDIN_FILENO, c, 1) == 1) ? 0 : -1;
+#endif
+}
+
+static int timeout_min(int a, int b)
+{
+    if (a < 0)
+    {
+        return b;
+    }
+    if (b < 0)
+    {
+        return a;
+    }
+    return (a < b) ? a : b;
+}
+
+static int tty_poll(short revents[POLL_ID_END], int timeout)
+{
+    POLL_Event_t events[POLL_ID_END];
+    int status;
+
+    int ready = 0;
+
+    memset(revents, 0, sizeof(short) * POLL_ID_END);
+
+    /* Handles the poll set refused are always ready, don't block on the rest */
+    for (int i = 0; i < POLL_ID_END; i++)
+    {
+        if (poll_always_ready[i])
+        {
+            revents[i] = poll_always_ready[i];
+            ready++;
+            timeout = 0;
+        }
+    }
+
+    status = POLL_Wait(poll_set, events, POLL_ID_END, timeout);
+    if (status < 0)
+    {
+        return status;
+    }
+    for (int i = 0; i < status; i++)
+    {
+        revents[events[i].Id] = events[i].revents;
+    }
+
+    return status + ready;
+}
+
+/* Serial reader thread, only moves data from the port into rx_ring so
+ * slow stdout or log writes can't make the device buffer overflow. Each
+ * chunk is stamped with its arrival time before being queued. */
+static void *tty_rx_thread(void *arg)
+{
+    (void)arg;
+    char buffer[sizeof(rx_chunk_t) + BUFSIZ];
+    rx_chunk_t *chunk = (rx_chunk_t *) buffer;
+    char *data = buffer + sizeof(rx_chunk_t);
+    pollfd_t fds[2] =
+    {
+        { .fd = ((WAIT_HANDLE*)sp_event->handles)[0], .events = POLL_IN },
+        { .fd = SEM_GetWaitable(ev_rx_stop), .events = POLL_IN },
+    };
+
+#ifdef _WIN32
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+#endif
+
+    while (true)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            break;
+        }
+
+        if (fds[1].revents & POLL_IN)
+        {
+            /* Stop requested */
+            return NULL;
+        }
+
+        /* Read straight into the ring when there is contiguous room for
+         * the header and some data, header is filled in afterwards */
+        char *span;
+        uint32_t room = RING_WriteReserve(rx_ring, (void **) &span);
+        bool direct = room > sizeof(rx_chunk_t);
+        char *target = direct ? span + sizeof(rx_chunk_t) : data;
+
+        ssize_t bytes_read = sp_nonblocking_read(hPort, target, direct ? MIN(room - sizeof(rx_chunk_t), BUFSIZ) : BUFSIZ);
+        if ((bytes_read < 0) || ((bytes_read == 0) && (fds[0].revents & (POLL_HUP | POLL_ERR))))
+        {
+            /* Error reading - device is likely unplugged */
+            break;
+        }
+
+        if ((bytes_read > 0) && direct)
+        {
+            timestamp_capture(&chunk->stamp);
+            chunk->length = bytes_read;
+            memcpy(span, chunk, sizeof(rx_chunk_t));
+            RING_WriteCommit(rx_ring, sizeof(rx_chunk_t) + bytes_read);
+        }
+        else if (bytes_read > 0)
+        {
+            uint32_t space = RING_Get_Free(rx_ring);
+            uint32_t length = 0;
+
+            timestamp_capture(&chunk->stamp);
+
+            /* Header and data are queued at once so the consumer always
+             * sees complete chunks */
+            if (space > sizeof(rx_chunk_t))
+            {
+                length = space - sizeof(rx_chunk_t);
+                if (length > (uint32_t) bytes_read)
+                {
+                    length = bytes_read;
+                }
+                chunk->length = length;
+                RING_Write(rx_ring, buffer, sizeof(rx_chunk_t) + length);
+            }
+
+            if (length < (uint32_t) bytes_read)
+            {
+                /* Renderer is too slow, account for what could not be kept */
+                rx_dropped += bytes_read - length;
+            }
+        }
+    }
+
+    SEM_Give(ev_rx_error);
+
+    return NULL;
+}
+
+static void tty_rx_thread_start(void)
+{
+    SEM_Take(ev_rx_stop);
+    SEM_Take(ev_rx_error);
+
+    if (pthread_create(&rx_thread, NULL, tty_rx_thread, NULL) != 0)
+    {
+        tio_error_printf("pthread_create() error");
+        exit(EXIT_FAILURE);
+    }
+    rx_thread_running = true;
+
+#ifndef _WIN32
+    // Needs privileges, keep default scheduling otherwise
+    static bool sched_reported = false;
+    struct sched_param param = { .sched_priority = sched_get_priority_min(SCHED_FIFO) };
+    int error = pthread_setschedparam(rx_thread, SCHED_FIFO, &param);
+    if ((error != 0) && !sched_reported)
+    {
+        tio_debug_printf("Reader thread keeps default scheduling (%s)", strerror(error));
+        sched_reported = true;
+    }
+#endif
+}
+
+/* Read received data belonging to a single chunk, stamp is set to the
+ * chunk arrival time when not NULL */
+static ssize_t tty_rx_read(void *buffer, size_t count, timestamp_stamp_t *stamp)
+{
+    if (rx_chunk_left == 0)
+    {
+        rx_chunk_t chunk;
+
+        if (RING_Get_Count(rx_ring) < sizeof(rx_chunk_t))
+        {
+            return 0;
+        }
+
+        RING_Read(rx_ring, &chunk, sizeof(rx_chunk_t));
+        rx_chunk_left = chunk.length;
+        rx_chunk_stamp = chunk.stamp;
+    }
+
+    if (count > rx_chunk_left)
+    {
+        count = rx_chunk_left;
+    }
+
+    ssize_t bytes_read = RING_Read(rx_ring, buffer, count);
+    rx_chunk_left -= bytes_read;
+
+    if (stamp != NULL)
+    {
+        *stamp = rx_chunk_stamp;
+    }
+
+    return bytes_read;
+}
+
+/* Same as tty_rx_read() but hands out received data in place, it stays
+ * valid until released with tty_rx_release() */
+static ssize_t tty_rx_peek(const char **data, size_t count, timestamp_stamp_t *stamp)
+{
+    if (rx_chunk_left == 0)
+    {
+        rx_chunk_t chunk;
+
+        if (RING_Get_Count(rx_ring) < sizeof(rx_chunk_t))
+        {
+            return 0;
+        }
+
+        RING_Read(rx_ring, &chunk, sizeof(rx_chunk_t));
+        rx_chunk_left = chunk.length;
+        rx_chunk_stamp = chunk.stamp;
+    }
+
+    size_t available = RING_ReadPeek(rx_ring, (void **) data);
+    count = MIN(count, MIN(available, rx_chunk_left));
+
+    *stamp = rx_chunk_stamp;
+
+    return count;
+}
+
+static void tty_rx_release(size_t count)
+{
+    RING_ReadRelease(rx_ring, count);
+    rx_chunk_left -= count;
+}
+
+static void tty_rx_thread_stop(void)
+{
+    if (!rx_thread_running)
+    {
+        return;
+    }
+
+    SEM_Give(ev_rx_stop);
+    pthread_join(rx_thread, NULL);
+    rx_thread_running = false;
+
+    /* Discard data of previous connection */
+    tty_read_flush();
+}
+
+static void tty_rx_dropped_check(void)
+{
+    unsigned long dropped = rx_dropped;
+
+    if (dropped != rx_dropped_reported)
+    {
+        tio_warning_printf("Dropped %lu received bytes, output is too slow", dropped - rx_dropped_reported);
+        rx_dropped_reported = dropped;
+    }
+}
+
+/* Read from tty device through the reader thread, waits at most timeout
+ * milliseconds for all bytes (0 or negative waits forever). */
+ssize_t tty_read(void *buffer, size_t count, int timeout)
+{
+    char *data = buffer;
+    size_t bytes_read = 0;
+    pollfd_t fds[2] =
+    {
+        { .fd = RING_GetWaitable(rx_ring, RING_Available), .events = POLL_IN },
+        { .fd = SEM_GetWaitable(ev_rx_error), .events = POLL_IN },
+    };
+
+    uint64_t deadline = 0;
+
+    if (timeout > 0)
+    {
+        deadline = monotonic_us() + timeout * 1000ULL;
+    }
+
+    while (bytes_read < count)
+    {
+        ssize_t status = tty_rx_read(&data[bytes_read], count - bytes_read, NULL);
+        if (status > 0)
+        {
+            /* Data may span several chunks */
+            bytes_read += status;
+            continue;
+        }
+
+        /* Show what was printed so far before blocking */
+        print_flush();
+
+        /* Wait only for what is left of the timeout */
+        status = poll(fds, 2, deadline ? deadline_timeout(deadline) : -1);
+        if (status < 0)
+        {
+            return -1;
+        }
+        if (status == 0)
+        {
+            /* Timeout */
+            break;
+        }
+        if ((fds[1].revents & POLL_IN) && !(fds[0].revents & POLL_IN))
+        {
+            /* Reader stopped and nothing left */
+            return bytes_read ? (ssize_t) bytes_read : -1;
+        }
+    }
+
+    rx_total += bytes_read;
+
+    return bytes_read;
+}
+
+/* Discard received data which was not consumed yet */
+void tty_read_flush(void)
+{
+    void *data;
+    uint32_t count;
+
+    while ((count = RING_ReadPeek(rx_ring, &data)) > 0)
+    {
+        RING_ReadRelease(rx_ring, count);
+    }
+    rx_chunk_left = 0;
+}
+
+void tty_input_thread_create(void)
+{
+    ev_exit = SEM_Init(0, true);
+    ev_rx_stop = SEM_Init(0, true);
+    ev_rx_error = SEM_Init(0, true);
+
+    /* Only the reader thread writes and only the main loop reads, a
+     * mirrored ring lets every chunk be read and printed in place */
+    rx_ring = RING_Init_Mirror(RX_RING_SIZE);
+    if (rx_ring == NULL)
+    {
+        rx_ring = RING_Init_SPSC(RX_RING_SIZE);
+    }
+    if (rx_ring == NULL)
+    {
+        tio_error_printf("Could not allocate receive buffer");
+        exit(EXIT_FAILURE);
+    }
+
+    poll_set = POLL_Init(POLL_ID_END);
+    if (poll_set == NULL)
+    {
+        tio_error_printf("Could not create poll set");
+        exit(EXIT_FAILURE);
+    }
+
+#ifdef _WIN32
+    pthread_mutex_lock(&mutex_input_ready);
+
+    if (pthread_create(&thread, NULL, tty_stdin_input_thread, NULL) != 0) {
+        tio_error_printf("pthread_create() error");
+        exit(1);
+    }
+#endif
+}
+
+void tty_input_thread_wait_ready(void)
+{
+#ifdef _WIN32
+    pthread_mutex_lock(&mutex_input_ready);
+#endif
+
+    /* Stdin, receive ring and exit event are watched for the whole session */
+    tty_poll_add(RING_GetWaitable(rx_ring, RING_Available), POLL_IN, POLL_ID_TTY, "receive ring");
+    tty_poll_add(SEM_GetWaitable(ev_rx_error), POLL_IN, POLL_ID_TTY_ERROR, "receive error event");
+    tty_poll_add(SEM_GetWaitable(ev_exit), POLL_IN, POLL_ID_EXIT, "exit event");
+    tty_poll_add(stdin_waitable(), POLL_IN, POLL_ID_STDIN, "stdin");
+}
+
+/* Typed hex pair is shown briefly before it is erased */
+static void hex_prompt_erase(void *arg)
+{
+    UNUSED(arg);
+
+    hex_erase_timer = TIMER_INVALID;
+    printf("\b \b");
+    printf("\b \b");
+    print_flush();
+}
+
+static void handle_hex_prompt(char c)
+{
+    // Erase previous pair before echoing the next character
+    if (timer_pending(hex_erase_timer))
+    {
+        timer_stop(hex_erase_timer);
+        hex_prompt_erase(NULL);
+    }
+
+    hex_chars[hex_char_index++] = c;
+
+    printf("%c", c);
+    print_tainted_set();
+
+    if (hex_char_index == 2)
+    {
+        if (option.local_echo == false)
+        {
+            hex_erase_timer = timer_start(HEX_PROMPT_ERASE_DELAY, hex_prompt_erase, NULL);
+            if (hex_erase_timer == TIMER_INVALID)
+            {
+                hex_prompt_erase(NULL);
+            }
+        }
+        else
+        {
+            printf(" ");
+        }
+
+        unsigned char hex_value = char_to_nibble(hex_chars[0]) << 4 | (char_to_nibble(hex_chars[1]) & 0x0F);
+        hex_char_index = 0;
+
+        ssize_t status = tty_write(&hex_value, 1);
+        if (status < 0)
+        {
+            tio_warning_printf("Could not write to tty device");
+        }
+        else
+        {
+            tx_total++;
+        }
+    }
+}
+
+void tty_line_set(int mask, int value)
+{
+    struct sp_port_config* config;
+    sp_new_config(&config);
+    sp_get_config(hPort, config);
+    if(mask & TIOCM_DTR) {
+        sp_set_config_dtr(config, (value & TIOCM_DTR) ? SP_DTR_ON : SP_DTR_OFF);
+        tio_printf("Setting DTR to %s", (value & TIOCM_DTR) ? "LOW" : "HIGH");
+    }
+    if(mask & TIOCM_RTS) {
+        sp_set_config_rts(config, (value & TIOCM_RTS) ? SP_RTS_ON : SP_RTS_OFF);
+        tio_printf("Setting RTS to %s", (value & TIOCM_RTS) ? "LOW" : "HIGH");
+    }
+    sp_set_config(hPort, config);
+    sp_free_config(config);
+}
+
+void tty_line_toggle(int mask)
+{
+    struct sp_port_config* config;
+    sp_new_config(&config);
+    sp_get_config(hPort, config);
+    enum sp_dtr dtr;
+    enum sp_rts rts;
+    sp_get_config_dtr(config, &dtr);
+    sp_get_config_rts(config, &rts);
+    if(mask & TIOCM_DTR) {
+        sp_set_config_dtr(config, dtr == SP_DTR_OFF ? SP_DTR_ON : SP_DTR_OFF);
+        tio_printf("Setting DTR to %s", dtr == SP_DTR_OFF ? "LOW" : "HIGH");
+    }
+    if(mask & TIOCM_RTS) {
+        sp_set_config_rts(config, rts == SP_RTS_OFF ? SP_RTS_ON : SP_RTS_OFF);
+        tio_printf("Setting RTS to %s", rts == SP_RTS_OFF ? "LOW" : "HIGH");
+    }
+    sp_set_config(hPort, config);
+    sp_free_config(config);
+}
+
+static void tty_line_pulse_end(void *arg)
+{
+    UNUSED(arg);
+
+    line_pulse_timer = TIMER_INVALID;
+    tty_line_toggle(line_pulse_mask);
+}
+
+static void tty_line_pulse(int mask, unsigned int duration)
+{
+    // Complete a pulse which is still running first
+    if (timer_pending(line_pulse_timer))
+    {
+        timer_stop(line_pulse_timer);
+        tty_line_pulse_end(NULL);
+    }
+
+    tty_line_toggle(mask);
+
+    if (duration > 0)
+    {
+        tio_printf("Waiting %d ms", duration);
+        line_pulse_mask = mask;
+        line_pulse_timer = timer_start(duration, tty_line_pulse_end, NULL);
+        if (line_pulse_timer != TIMER_INVALID)
+        {
+            return;
+        }
+        delay(duration);
+    }
+
+    tty_line_toggle(mask);
+}
+
+static void tty_line_poke(int mask, tty_line_mode_t mode, unsigned int duration)
+{
+    switch (mode)
+    {
+        case LINE_TOGGLE:
+            tty_line_toggle(mask);
+            break;
+
+        case LINE_PULSE:
+            tty_line_pulse(mask, duration);
+            break;
+    }
+}
+
+static int tio_readln(void)
+{
+    char *p = line;
+
+    /* Read line, accept BS and DEL as rubout characters */
+    for (p = line ; p < &line[LINE_SIZE_MAX-1]; )
+    {
+        if (stdin_read_blocking(p) == 0)
+        {
+            if (*p == 0x08 || *p == 0x7f)
+            {
+                if (p > line )
+                {
+                    write(STDOUT_FILENO, "\b \b", 3);
+                    p--;
+                }
+                continue;
+            }
+            write(STDOUT_FILENO, p, 1);
+            if (*p == '\r') break;
+            p++;
+        }
+    }
+    *p = 0;
+    return (p - line);
+}
+
+void tty_output_mode_set(output_mode_t mode)
+{
+    switch (mode)
+    {
+        case OUTPUT_MODE_NORMAL:
+            print = print_normal;
+            print_buffer = print_normal_buffer;
+            break;
+
+        case OUTPUT_MODE_HEX:
+            print = print_hex;
+            print_buffer = print_hex_buffer;
+            hexdump_init(option.hex_mode_width);
+            break;
+
+        case OUTPUT_MODE_END:
+            break;
+    }
+}
+
+/* True if the next input byte can't be part of a key command sequence */
+static bool command_sequence_idle(void)
+{
+    return (sub_command == SUBCOMMAND_NONE) &&
+           !(option.prefix_enabled && (command_previous_char == option.prefix_code));
+}
+
+void handle_command_sequence(char input_char, char *output_char, bool *forward)
+{
+    char unused_char;
+    bool unused_bool;
+    static tty_line_mode_t line_mode;
+
+    /* Ignore unused arguments */
+    if (output_char == NULL)
+    {
+        output_char = &unused_char;
+    }
+
+    if (forward == NULL)
+    {
+        forward = &unused_bool;
+    }
+
+    // Handle tty line toggle and pulse action
+    if (sub_command)
+    {
+        *forward = false;
+
+        switch (sub_command)
+        {
+            case SUBCOMMAND_NONE:
+                break;
+
+            case SUBCOMMAND_LINE_TOGGLE:
+            case SUBCOMMAND_LINE_PULSE:
+        switch (input_char)
+        {
+            case KEY_0:
+                tty_line_poke(TIOCM_DTR, line_mode, option.dtr_pulse_duration);
+                break;
+            case KEY_1:
+                tty_line_poke(TIOCM_RTS, line_mode, option.rts_pulse_duration);
+                break;
+            case KEY_2:
+                tty_line_poke(TIOCM_DTR | TIOCM_RTS, line_mode, option.pulse_duration);
+                break;
+            default:
+                tio_warning_printf("Invalid line number");
+                break;
+        }
+                break;
+
+            case SUBCOMMAND_XMODEM:
+                switch (input_char)
+                {
+                    case KEY_0:
+                        tio_printf("Send file with XMODEM-1K");
+                        tio_printf_raw("Enter file name: ");
+                        if (tio_readln())
+                        {
+                            tio_printf("Sending file '%s'  ", line);
+                            tio_printf("Press any key to abort transfer");
+                            tty_drain();
+                            tio_printf("%s", xymodem_send(hPort, line, XMODEM_1K) < 0 ? "Aborted" : "Done");
+                        }
+                        break;
+
+                    case KEY_1:
+                        tio_printf("Send file with XMODEM-CRC");
+                        tio_printf_raw("Enter file name: ");
+                        if (tio_readln())
+                        {
+                            tio_printf("Sending file '%s'  ", line);
+                            tio_printf("Press any key to abort transfer");
+                            tty_drain();
+                            tio_printf("%s", xymodem_send(hPort, line, XMODEM_CRC) < 0 ? "Aborted" : "Done");
+                        }
+                        break;
+                }
+                break;
+        }
+
+        sub_command = SUBCOMMAND_NONE;
+        return;
+    }
+
+    /* Handle escape key commands */
+    if (option.prefix_enabled && command_previous_char == option.prefix_code)
+    {
+        /* Do not forward input char to output by default */
+        *forward = false;
+
+        /* Handle special double prefix key input case */
+        if (input_char == option.prefix_code)
+        {
+            /* Forward prefix character to tty */
+            *output_char = option.prefix_code;
+            *forward = true;
+            command_previous_char = 0;
+            return;
+        }
+
+        // Handle commands
+        switch (input_char)
+        {
+            case KEY_QUESTION:
+                tio_printf("Key commands:");
+                tio_printf(" ctrl-%c ?       List available key commands", option.prefix_key);
+                tio_printf(" ctrl-%c b       Send break", option.prefix_key);
+                tio_printf(" ctrl-%c c       Show configuration", option.prefix_key);
+                tio_printf(" ctrl-%c e       Toggle local echo mode", option.prefix_key);
+                tio_printf(" ctrl-%c f       Toggle log to file", option.prefix_key);
+                tio_printf(" ctrl-%c F       Flush data I/O buffers", option.prefix_key);
+                tio_printf(" ctrl-%c g       Toggle serial port line", option.prefix_key);
+                tio_printf(" ctrl-%c i       Toggle input mode", option.prefix_key);
+                tio_printf(" ctrl-%c k       Run line sequence", option.prefix_key);
+                tio_printf(" ctrl-%c l       Clear screen", option.prefix_key);
+                tio_printf(" ctrl-%c L       Show line states", option.prefix_key);
+                tio_printf(" ctrl-%c m       Toggle MSB to LSB bit order", option.prefix_key);
+                tio_printf(" ctrl-%c o       Toggle output mode", option.prefix_key);
+                tio_printf(" ctrl-%c p       Pulse serial port line", option.prefix_key);
+                tio_printf(" ctrl-%c q       Quit", option.prefix_key);
+                tio_printf(" ctrl-%c r       Run script", option.prefix_key);
+                tio_printf(" ctrl-%c s       Show statistics", option.prefix_key);
+                tio_printf(" ctrl-%c t       Toggle line timestamp mode", option.prefix_key);
+                tio_printf(" ctrl-%c U       Toggle conversion to uppercase on output", option.prefix_key);
+                tio_printf(" ctrl-%c v       Show version", option.prefix_key);
+                tio_printf(" ctrl-%c w       Send raw file", option.prefix_key);
+                tio_printf(" ctrl-%c x       Send file via Xmodem", option.prefix_key);
+                tio_printf(" ctrl-%c X       Send file via Xmodem-CRC", option.prefix_key);
+                tio_printf(" ctrl-%c y       Send file via Ymodem", option.prefix_key);
+                tio_printf(" ctrl-%c ctrl-%c  Send ctrl-%c character", option.prefix_key, option.prefix_key, option.prefix_key);
+                break;
+
+            case KEY_SHIFT_L:
+            {
+                enum sp_signal signal;
+                if (sp_get_signals(hPort, &signal) < 0)
+                {
+                    tio_warning_printf("Could not get line state (%s)", GetErrorMessage(GetLastError()));
+                    break;
+                }
+                struct sp_port_config* config;
+                sp_new_config(&config);
+                sp_get_config(hPort, config);
+                enum sp_dtr dtr;
+                enum sp_rts rts;
+                enum sp_cts cts;
+                enum sp_dsr dsr;
+                sp_get_config_dtr(config,&dtr);
+                sp_get_config_rts(config,&rts);
+                sp_get_config_cts(config,&cts);
+                sp_get_config_dsr(config,&dsr);
+                sp_free_config(config);
+
+                tio_printf("Line states:");
+                tio_printf(" DTR: %s", (dtr == SP_DTR_OFF) ? "HIGH" : "LOW");
+                tio_printf(" RTS: %s", (rts == SP_RTS_OFF) ? "HIGH" : "LOW");
+                tio_printf(" CTS: %s", (signal & SP_SIG_CTS) ? "LOW" : "HIGH");
+                tio_printf(" DSR: %s", (signal & SP_SIG_DSR) ? "LOW" : "HIGH");
+                tio_printf(" DCD: %s", (signal & SP_SIG_DCD) ? "LOW" : "HIGH");
+                tio_printf(" RI : %s", (signal & SP_SIG_RI) ? "LOW" : "HIGH");
+                break;
+            }
+            case KEY_F:
+                if (option.log)
+                {
+                    log_close();
+                    option.log = false;
+                }
+                else
+                {
+                    if (log_open(option.log_filename) == 0)
+                    {
+                        option.log = true;
+                    }
+                }
+                tio_printf("Switched log to file %s", option.log ? "on" : "off");
+                break;
+
+            case KEY_SHIFT_F:
+                break;
+
+            case KEY_G:
+                tio_printf("Please enter which serial line number to toggle:");
+                tio_printf(" DTR        (0)");
+                tio_printf(" RTS        (1)");
+                tio_printf(" DTR+RTS    (2)");
+                line_mode = LINE_TOGGLE;
+                // Process next input character as part of the line toggle step
+                sub_command = SUBCOMMAND_LINE_TOGGLE;
+                break;
+
+            case KEY_P:
+                tio_printf("Please enter which serial line number to pulse:");
+                tio_printf(" DTR        (0)");
+                tio_printf(" RTS        (1)");
+                tio_printf(" DTR+RTS    (2)");
+                line_mode = LINE_PULSE;
+                // Process next input character as part of the line pulse step
+                sub_command = SUBCOMMAND_LINE_PULSE;
+                break;
+
+            case KEY_B:
+                tty_break();
+                break;
+
+            case KEY_C:
+                tio_printf("Configuration:");
+                options_print();
+                config_file_print();
+                break;
+
+            case KEY_E:
+                option.local_echo = !option.local_echo;
+                tio_printf("Switched local echo %s", option.local_echo ? "on" : "off");
+                break;
+
+            case KEY_I:
+                option.input_mode += 1;
+                switch (option.input_mode)
+                {
+                    case INPUT_MODE_NORMAL:
+                        break;
+                /* Toggle hexadecimal printing mode */
+                    case INPUT_MODE_HEX:
+                        option.input_mode = INPUT_MODE_HEX;
+                        tio_printf("Switched to hex input mode");
+                        break;
+
+                    case INPUT_MODE_LINE:
+                        option.input_mode = INPUT_MODE_LINE;
+                        tio_printf("Switched to line input mode");
+                        break;
+
+                    case INPUT_MODE_END:
+                        option.input_mode = INPUT_MODE_NORMAL;
+                        tio_printf("Switched to normal input mode");
+                        break;
+                }
+                break;
+
+            case KEY_K:
+                tio_printf("Line sequences:");
+                sequence_list();
+                tio_printf_raw("Enter sequence name or steps: ");
+                if (tio_readln())
+                {
+                    sequence_run(hPort, line);
+                }
+                break;
+
             case KEY_O:
                 option.output_mode += 1;
                 switch (option.output_mode)
                 {
-                    case OUTPUT_MODE_NORMAL:
-                        break;
+                    case OUTPUT_MODE_NORMAL:
+                        break;
+
+                    case OUTPUT_MODE_HEX:
+                        tty_output_mode_set(OUTPUT_MODE_HEX);
+                        tio_printf("Switched to hex output mode");
+                        break;
+
+                    case OUTPUT_MODE_END:
+                        option.output_mode = OUTPUT_MODE_NORMAL;
+                        tty_output_mode_set(OUTPUT_MODE_NORMAL);
+                        tio_printf("Switched to normal output mode");
+                        break;
+                }
+                break;
+
+            case KEY_L:
+                /* Clear screen using ANSI/VT100 escape code */
+                printf("\033c");
+                break;
+
+            case KEY_M:
+                /* Toggle bit order */
+                if (!map_o_msblsb)
+                {
+                    map_o_msblsb = true;
+                    tio_printf("Switched to reverse bit order");
+                }
+                else
+                {
+                    map_o_msblsb = false;
+                    tio_printf("Switched to normal bit order");
+                }
+                map_compile();
+                break;
+
+            case KEY_Q:
+                /* Exit upon ctrl-t q sequence */
+                exit(EXIT_SUCCESS);
+
+            case KEY_R:
+                /* Run script */
+                tty_drain();
+                script_run(hPort);
+                tty_tx_sync_prompt_compile();
+                break;
+
+            case KEY_S:
+                /* Show tx/rx statistics upon ctrl-t s sequence */
+                tio_printf("Statistics:");
+                tio_printf(" Sent %lu bytes", tx_total);
+                tio_printf(" Pending %lu bytes", (unsigned long) tty_tx_pending());
+                if (option.output_line_sync != LINE_SYNC_NONE)
+                {
+                    tio_printf(" Line sync timeouts %lu", tx_sync_timeouts);
+                }
+                if (tx_paced_count > 0)
+                {
+                    tio_printf(" Pacing jitter: mean %lu us, max %lu us", (unsigned long) (tx_jitter_sum / tx_paced_count),
+                                                                          (unsigned long) tx_jitter_max);
+                }
+                tio_printf(" Received %lu bytes", rx_total);
+                tio_printf(" Dropped %lu bytes", rx_dropped);
+                break;
+
+            case KEY_T:
+                option.timestamp += 1;
+                switch (option.timestamp)
+                {
+                    case TIMESTAMP_NONE:
+                        break;
+                    case TIMESTAMP_24HOUR:
+                        tio_printf("Switched to 24hour timestamp mode");
+                        break;
+                    case TIMESTAMP_24HOUR_START:
+                        tio_printf("Switched to 24hour-start timestamp mode");
+                        break;
+                    case TIMESTAMP_24HOUR_DELTA:
+                        tio_printf("Switched to 24hour-delta timestamp mode");
+                        break;
+                    case TIMESTAMP_ISO8601:
+                        tio_printf("Switched to iso8601 timestamp mode");
+                        break;
+                    case TIMESTAMP_END:
+                        option.timestamp = TIMESTAMP_NONE;
+                        tio_printf("Switched timestamp off");
+                        break;
+                }
+                break;
+
+            case KEY_U:
+                map_o_ltu = !map_o_ltu;
+                map_compile();
+                break;
+
+            case KEY_V:
+                tio_printf("tio v%s", VERSION);
+                break;
+
+            case KEY_W:
+                tio_printf("Send raw file");
+                tio_printf_raw("Enter file name: ");
+                if (tio_readln())
+                {
+                    tio_printf("Sending file '%s'", line);
+                    tio_printf("Press any key to abort transfer");
+                    tty_drain();
+                    tty_send_file(line, 0, 0);
+                }
+                break;
+
+            case KEY_X:
+                tio_printf("Please enter which X modem protocol to use:");
+                tio_printf(" (0) XMODEM-1K");
+                tio_printf(" (1) XMODEM-CRC");
+                // Process next input character as sub command
+                sub_command = SUBCOMMAND_XMODEM;
+                break;
+
+            case KEY_Y:
+                tio_printf("Send file with YMODEM");
+                tio_printf_raw("Enter file name: ");
+                if (tio_readln()) {
+                    tio_printf("Sending file '%s'  ", line);
+                    tio_printf("Press any key to abort transfer");
+                    tty_drain();
+                    tio_printf("%s", xymodem_send(hPort, line, YMODEM) < 0 ? "Aborted" : "Done");
+                }
+                break;
+
+            case KEY_Z:
+                tio_printf_array(random_array);
+                break;
+
+            default:
+                /* Ignore unknown ctrl-t escaped keys */
+                break;
+        }
+    }
+
+    command_previous_char = input_char;
+}
+
+void stdin_restore(void)
+{
+#ifndef _WIN32
+    tcsetattr(STDIN_FILENO, TCSANOW, &stdin_old);
+#endif
+}
+
+void stdin_configure(void)
+{
+#ifdef _WIN32
+    /* Prepare new stdin settings */
+    HANDLE hConsole = GetStdHandle(STD_INPUT_HANDLE);
+    DWORD mode = 0;
+    GetConsoleMode(hConsole, &mode); //
+
+
+    /* Reconfigure stdin (RAW configuration) */
+    mode &=~ENABLE_ECHO_INPUT;
+    mode &=~ENABLE_LINE_INPUT;
+    mode &=~ENABLE_PROCESSED_INPUT;
+    mode |= ENABLE_VIRTUAL_TERMINAL_INPUT;
+
+    /* Activate new stdin settings */
+    SetConsoleMode(hConsole, mode);
+#else
+    /* Save current stdin settings */
+    if (tcgetattr(STDIN_FILENO, &stdin_old) < 0)
+    {
+        tio_error_printf("Saving current stdin settings failed");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Prepare new stdin settings */
+    stdin_new = stdin_old;
+
+    /* Reconfigure stdin (RAW configuration) */
+    cfmakeraw(&stdin_new);
+
+    /* Control characters */
+    stdin_new.c_cc[VTIME] = 0; /* Inter-character timer unused */
+    stdin_new.c_cc[VMIN]  = 1; /* Blocking read until 1 character received */
+
+    /* Activate new stdin settings */
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &stdin_new) < 0)
+    {
+        tio_error_printf("Could not apply new stdin settings (%s)", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* Make sure we restore old stdin settings on exit */
+    atexit(&stdin_restore);
+#endif
+}
+
+void stdout_restore(void)
+{
+#ifndef _WIN32
+    tcsetattr(STDOUT_FILENO, TCSANOW, &stdout_old);
+#endif
+}
+
+void stdout_configure(void)
+{
+    /* Buffer stdout and flush explicitly. Received data is flushed within
+     * the output latency, local echo right after handling input. */
+    print_init_output_buffering();
+
+#ifdef _WIN32
+    HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode = 0;
+    GetConsoleMode(hConsole, &mode); //
+    mode |= ENABLE_PROCESSED_OUTPUT;
+    mode |= ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+    SetConsoleMode(hConsole, mode);
+
+    SetConsoleOutputCP(CP_UTF8);
+#else
+    /* Save current stdout settings */
+    if (tcgetattr(STDOUT_FILENO, &stdout_old) < 0)
+    {
+        tio_error_printf("Saving current stdio settings failed");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Reconfigure stdout (RAW configuration) */
+    stdout_new = stdout_old;
+    stdout_new.c_oflag &= ~(OCRNL | ONLCR | ONLRET | ONOCR | OFILL | OLCUC | OPOST);
+
+    /* Activate new stdout settings */
+    tcsetattr(STDOUT_FILENO, TCSANOW, &stdout_new);
+#endif
+
+    /* At start use normal print function */
+    print = print_normal;
+
+    /* Make sure we restore old stdout settings on exit */
+    atexit(&stdout_restore);
+}
+
+void tty_configure(void)
+{
+    if ((option.output_line_sync == LINE_SYNC_PROMPT) && (option.output_line_prompt == NULL))
+    {
+        tio_error_printf("Missing output line prompt");
+        exit(EXIT_FAILURE);
+    }
+    tty_tx_sync_prompt_compile();
+
+    sp_new_config(&cfgPort);
+    sp_new_config(&cfgPort_old);
+
+    /* Set speed */
+    sp_set_config_baudrate(cfgPort, option.baudrate);
+
+    /* Set databits */
+    sp_set_config_bits(cfgPort, option.databits);
+
+    /* Set flow control */
+    if (strcmp("hard", option.flow) == 0)
+    {
+        sp_set_config_flowcontrol(cfgPort, SP_FLOWCONTROL_RTSCTS);
+    }
+    else if (strcmp("soft", option.flow) == 0)
+    {
+        sp_set_config_flowcontrol(cfgPort, SP_FLOWCONTROL_XONXOFF);
+    }
+    else if (strcmp("none", option.flow) == 0)
+    {
+        sp_set_config_flowcontrol(cfgPort, SP_FLOWCONTROL_NONE);
+    }
+    else
+    {
+        tio_error_printf("Invalid flow control");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Set stopbits */
+    sp_set_config_stopbits(cfgPort, option.stopbits);
+
+    /* Set parity */
+    if (strcmp("odd", option.parity) == 0)
+    {
+        sp_set_config_parity(cfgPort, SP_PARITY_ODD);
+    }
+    else if (strcmp("even", option.parity) == 0)
+    {
+       sp_set_config_parity(cfgPort, SP_PARITY_EVEN);
+    }
+    else if (strcmp("none", option.parity) == 0)
+    {
+        sp_set_config_parity(cfgPort, SP_PARITY_NONE);
+    }
+    else if ( strcmp("mark", option.parity) == 0)
+    {
+        sp_set_config_parity(cfgPort, SP_PARITY_MARK);
+    }
+    else if ( strcmp("space", option.parity) == 0)
+    {
+        sp_set_config_parity(cfgPort, SP_PARITY_SPACE);
+    }
+    else
+    {
+        tio_error_printf("Invalid parity");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Configure any specified input or output mappings */
+    char * buffer = strdup(option.map);
+    bool token_found = true;
+    char *token = NULL;
+    while (token_found == true)
+    {
+        if (token == NULL)
+        {
+            token = strtok(buffer,",");
+        }
+        else
+        {
+            token = strtok(NULL, ",");
+        }
+
+        if (token != NULL)
+        {
+            if (strcmp(token,"INLCR") == 0)
+            {
+                map_i_nl_cr = true;
+            }
+            else if (strcmp(token,"IGNCR") == 0)
+            {
+                map_ign_cr = true;
+            }
+            else if (strcmp(token,"ICRNL") == 0)
+            {
+                map_i_cr_nl = true;
+            }
+            else if (strcmp(token,"OCRNL") == 0)
+            {
+                map_o_cr_nl = true;
+            }
+            else if (strcmp(token,"ODELBS") == 0)
+            {
+                map_o_del_bs = true;
+            }
+            else if (strcmp(token,"IFFESCC") == 0)
+            {
+                map_i_ff_escc = true;
+            }
+            else if (strcmp(token,"INLCRNL") == 0)
+            {
+                map_i_nl_crnl = true;
+            }
+            else if (strcmp(token, "ONLCRNL") == 0)
+            {
+                map_o_nl_crnl = true;
+            }
+            else if (strcmp(token, "OLTU") == 0)
+            {
+                map_o_ltu = true;
+            }
+            else if (strcmp(token, "MSB2LSB") == 0)
+            {
+                map_o_msblsb = true;
+            }
+            else
+            {
+                printf("Error: Unknown mapping flag %s\n", token);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else
+        {
+            token_found = false;
+        }
+    }
+    free(buffer);
+
+    map_compile();
+}
+
+void tty_wait_for_device(void)
+{
+    int    status;
+    int    timeout;
+    static char input_char;
+    static bool first = true;
+    static unsigned long last_errno = 0;
+
+    /* Loop until device pops up */
+    while (true)
+    {
+        if (interactive_mode)
+        {
+            /* In interactive mode, while waiting for tty device, we need to
+             * read from stdin to react on input key commands. */
+            if (first)
+            {
+                /* Don't wait first time */
+                timeout = 0;
+                first = false;
+            }
+            else
+            {
+                /* Wait up to 1 second for input */
+                timeout = 1000;
+            }
+
+            short revents[POLL_ID_END];
+
+            /* Block until input becomes available, a timer is due or timeout */
+            status = tty_poll(revents, timeout_min(timeout, timer_timeout()));
+            timer_run();
+            if (status > 0)
+            {
+                /* Input from stdin ready */
+                if (revents[POLL_ID_STDIN] & POLL_IN)
+                {
+                    /* Read one character */
+                    status = stdin_read(&input_char, 1);
+                    if (status <= 0)
+                    {
+                        tio_error_printf("Could not read from stdin");
+                        exit(EXIT_FAILURE);
+                    }
 
-                    case OUTPUT_MODE_HEX:
-                        tty_output_mode_set(OUTPUT_MODE_HEX);
-                        tio_printf("Switched to hex output mode");
-                        break;
+                    /* Handle commands */
+                    handle_command_sequence(input_char, NULL, NULL);
+                }
+                /* Exit called */
+                else if (revents[POLL_ID_EXIT] & POLL_IN)
+                {
+                    exit(EXIT_SUCCESS);
+                }
+            }
+            else if (status == -1)
+            {
+                tio_error_printf("poll() failed (%s)", GetErrorMessage(GetLastError()));
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        /* Open tty device */
+        if (sp_get_port_by_name(option.tty_device, &hPort) == SP_OK)
+        {
+            if (sp_open(hPort, SP_MODE_READ_WRITE) == SP_OK)
+            {
+                last_errno = 0;
+                return;
+            }
+            else
+            {
+                sp_free_port(hPort);
+            }
+        }
+
+        if (last_errno != (unsigned long)GetLastError())
+        {
+            tio_warning_printf("Could not open tty device (%s)", GetErrorMessage(GetLastError()));
+            tio_printf("Waiting for tty device..");
+            last_errno = GetLastError();
+        }
+
+        if (!interactive_mode)
+        {
+            /* In non-interactive mode we do not need to handle input key
+             * commands so we simply sleep 1 second between checking for
+             * presence of tty device, or until a timer is due */
+            delay(timeout_min(1000, timer_timeout()));
+            timer_run();
+        }
+    }
+}
+
+void tty_disconnect(void)
+{
+    if (InterlockedCompareExchange(&connected, false, true))
+    {
+        tio_printf("Disconnected");
+
+        tty_rx_thread_stop();
+
+        /* Data not handed over to the driver yet is lost */
+        tty_tx_wait_set(false);
+        tx_count = 0;
+        tx_timer_armed = false;
+
+        /* Break and line pulse end with the port */
+        timer_stop(break_timer);
+        timer_stop(line_pulse_timer);
+        tx_break = false;
+
+        sp_close(hPort);
+        sp_free_port(hPort);
+
+        /* Fire alert action */
+        alert_disconnect();
+    }
+}
+
+void tty_restore(void)
+{
+    /* Complete scheduled actions and send what is still queued before leaving */
+    if (connected)
+    {
+        timer_flush();
+        tty_drain();
+    }
+
+    sp_set_config(hPort, cfgPort_old);
+
+    if (connected)
+    {
+        tty_disconnect();
+    }
+
+    /* Let disconnect alert finish */
+    timer_flush();
+}
+
+void forward_to_tty(char output_char)
+{
+    int status = 0;
+    const char *expand;
+
+    /* Map output character */
+    output_char = map_tx.xlate[(unsigned char) output_char];
+    expand = map_tx.expand[(unsigned char) output_char];
+
+    if (expand != NULL)
+    {
+        size_t i, length = strlen(expand);
+
+        for (i = 0; i < length; i++)
+        {
+            optional_local_echo(expand[i]);
+        }
+        status = tty_write(expand, length);
+        if (status < 0)
+        {
+            tio_warning_printf("Could not write to tty device");
+        }
 
-                    case OUTPUT_MODE_END:
-                        option.output_mode = OUTPUT_MODE_NORMAL;
-                        tty_output_mode_set(OUTPUT_MODE_NORMAL);
-                        tio_printf("Switched to normal output mode");
-                        break;
+        tx_total += length;
+    }
+    else
+    {
+        switch (option.output_mode)
+        {
+            case OUTPUT_MODE_NORMAL:
+                if (option.input_mode == INPUT_MODE_HEX)
+                {
+                    handle_hex_prompt(output_char);
                 }
-                break;
+                else
+                {
+                    /* Send output to tty device */
+                    optional_local_echo(output_char);
+                    if ((output_char == 0) && (map_o_nulbrk))
+                    {
+                        tty_break();
+                    }
+                    else
+                    {
+                        status = tty_write(&output_char, 1);
+                    }
+                    if (status < 0)
+                    {
+                        tio_warning_printf("Could not write to tty device");
+                    }
 
-            case KEY_L:
-                /* Clear screen using ANSI/VT100 escape code */
-                printf("\033c");
+                    /* Update transmit statistics */
+                    tx_total++;
+                }
                 break;
 
-            case KEY_M:
-                /* Toggle bit order */
-                if (!map_o_msblsb)
+            case OUTPUT_MODE_HEX:
+                if (option.input_mode == INPUT_MODE_HEX)
                 {
-                    map_o_msblsb = true;
-                    tio_printf("Switched to reverse bit order");
+                    handle_hex_prompt(output_char);
                 }
                 else
                 {
-                    map_o_msblsb = false;
-                    tio_printf("Switched to normal bit order");
+                    optional_local_echo(output_char);
                 }
                 break;
 
-            case KEY_Q:
-                /* Exit upon ctrl-t q sequence */
-                exit(EXIT_SUCCESS);
-
-            case KEY_R:
-                /* Run script */
-                script_run(hPort);
+            case OUTPUT_MODE_END:
                 break;
+        }
+    }
+}
 
-            case KEY_S:
-                /* Show tx/rx statistics upon ctrl-t s sequence */
-                tio_printf("Statistics:");
-                tio_printf(" Sent %lu bytes", tx_total);
-                tio_printf(" Received %lu bytes", rx_total);
-                break;
+/* Forward a run of input bytes which contains no key command, same as
+ * forward_to_tty() for each byte but mapped, echoed and written in bulk */
+static void forward_run_to_tty(const char *buffer, size_t count)
+{
+    char out[BUFSIZ];
+    size_t i = 0, n = 0;
 
-            case KEY_T:
-                option.timestamp += 1;
-                switch (option.timestamp)
+    while (i < count)
+    {
+        unsigned char c = map_tx.xlate[(unsigned char) buffer[i]];
+        const char *expand = map_tx.expand[c];
+        size_t length = expand ? strlen(expand) : 1;
+
+        // Break on NUL needs the byte by byte path
+        bool special = (expand == NULL) && (c == 0) && map_o_nulbrk;
+
+        if (special || (n + length > sizeof(out)))
+        {
+            if (n > 0)
+            {
+                if (option.local_echo)
                 {
-                    case TIMESTAMP_NONE:
-                        break;
-                    case TIMESTAMP_24HOUR:
-                        tio_printf("Switched to 24hour timestamp mode");
-                        break;
-                    case TIMESTAMP_24HOUR_START:
-                        tio_printf("Switched to 24hour-start timestamp mode");
-                        break;
-                    case TIMESTAMP_24HOUR_DELTA:
-                        tio_printf("Switched to 24hour-delta timestamp mode");
-                        break;
-                    case TIMESTAMP_ISO8601:
-                        tio_printf("Switched to iso8601 timestamp mode");
-                        break;
-                    case TIMESTAMP_END:
-                        option.timestamp = TIMESTAMP_NONE;
-                        tio_printf("Switched timestamp off");
-                        break;
+                    print_buffer(out, n);
+                    if (option.log)
+                    {
+                        log_write(out, n);
+                    }
                 }
-                break;
+                if (tty_write(out, n) < 0)
+                {
+                    tio_warning_printf("Could not write to tty device");
+                }
+                tx_total += n;
+                n = 0;
+            }
 
-            case KEY_U:
-                map_o_ltu = !map_o_ltu;
-                break;
+            if (special)
+            {
+                forward_to_tty(buffer[i++]);
+            }
+            continue;
+        }
 
-            case KEY_V:
-                tio_printf("tio v%s", VERSION);
-                break;
+        if (expand)
+        {
+            memcpy(&out[n], expand, length);
+        }
+        else
+        {
+            out[n] = c;
+        }
+        n += length;
+        i++;
+    }
 
-            case KEY_X:
-                tio_printf("Please enter which X modem protocol to use:");
-                tio_printf(" (0) XMODEM-1K");
-                tio_printf(" (1) XMODEM-CRC");
-                // Process next input character as sub command
-                sub_command = SUBCOMMAND_XMODEM;
-                break;
+    if (n > 0)
+    {
+        if (option.local_echo)
+        {
+            print_buffer(out, n);
+            if (option.log)
+            {
+                log_write(out, n);
+            }
+        }
+        if (tty_write(out, n) < 0)
+        {
+            tio_warning_printf("Could not write to tty device");
+        }
+        tx_total += n;
+    }
 
-            case KEY_Y:
-                tio_printf("Send file with YMODEM");
-                tio_printf_raw("Enter file name: ");
-                if (tio_readln()) {
-                    tio_printf("Sending file '%s'  ", line);
-                    tio_printf("Press any key to abort transfer");
-                    tio_printf("%s", xymodem_send(hPort, line, YMODEM) < 0 ? "Aborted" : "Done");
+    command_previous_char = buffer[count - 1];
+}
+
+/* Decode a run of hex input which contains no key command, such as a pasted
+ * hex stream, and write the decoded bytes to tty in one go. Input is mapped
+ * like typed hex digits before it is decoded. */
+static void forward_hex_run_to_tty(const char *buffer, size_t count)
+{
+    static unsigned char data[BUFSIZ / 2 + 1];
+    char text[BUFSIZ];
+    char echo[3 * 256];
+    size_t invalid, length, n;
+    size_t i = 0;
+
+    while (i < count)
+    {
+        // Digit on the prompt is the pending high nibble
+        int pending = (hex_char_index == 1) ? char_to_nibble(hex_chars[0]) : -1;
+
+        length = MIN(count - i, sizeof(text));
+        for (size_t j = 0; j < length; j++)
+        {
+            text[j] = map_tx.xlate[(unsigned char) buffer[i + j]];
+        }
+        i += length;
+
+        n = scan_hex_decode_stream(&pending, data, text, length, &invalid);
+
+        if (hex_char_index == 1)
+        {
+            // Completed or dropped, either way it leaves the prompt
+            hex_char_index = 0;
+            printf("\b \b");
+        }
+
+        if (invalid > 0)
+        {
+            tio_warning_printf("Skipped %zu invalid hex character%s", invalid, (invalid > 1) ? "s" : "");
+        }
+
+        if (n > 0)
+        {
+            if (option.local_echo)
+            {
+                for (size_t j = 0; j < n; j += sizeof(echo) / 3)
+                {
+                    size_t chunk = MIN(n - j, sizeof(echo) / 3);
+                    fwrite(echo, 1, hexdump_format(echo, (const char *) &data[j], chunk), stdout);
                 }
-                break;
+                print_tainted_set();
+            }
 
-            case KEY_Z:
-                tio_printf_array(random_array);
-                break;
+            if (tty_write(data, n) < 0)
+            {
+                tio_warning_printf("Could not write to tty device");
+            }
+            else
+            {
+                tx_total += n;
+            }
+        }
 
-            default:
-                /* Ignore unknown ctrl-t escaped keys */
-                break;
+        if (pending >= 0)
+        {
+            // Unpaired trailing digit waits for its other half
+            handle_hex_prompt(text[length - 1]);
+        }
+    }
+
+    command_previous_char = buffer[count - 1];
+}
+
+static inline bool rx_is_special(char c)
+{
+    /* Characters which may be mapped or start a new timestamped line */
+    return (c == '\n') || (map_rx.expand[(unsigned char) c] != NULL);
+}
+
+static void rx_putc(char c)
+{
+    const char *expand = map_rx.expand[(unsigned char) c];
+
+    /* Map input character */
+    if (expand != NULL)
+    {
+        while (*expand)
+        {
+            print(*expand++);
+        }
+    }
+    else
+    {
+        /* Print received tty character to stdout */
+        print(c);
+    }
+
+    /* Write to log */
+    if (option.log)
+    {
+        log_putc(c);
+    }
+
+    if (c == '\n' && option.timestamp)
+    {
+        next_timestamp = true;
+    }
+}
+
+static void rx_write(const char *buffer, size_t count)
+{
+    /* Print received tty characters to stdout */
+    print_buffer(buffer, count);
+
+    /* Write to log */
+    if (option.log)
+    {
+        log_write(buffer, count);
+    }
+}
+
+/* Restart inactivity timer for data which arrived at stamp */
+static void tty_rx_idle_arm(const timestamp_stamp_t *stamp)
+{
+    if ((option.timestamp == TIMESTAMP_NONE) || (option.timestamp_timeout <= 0))
+    {
+        rx_idle_pending = false;
+        return;
+    }
+
+    rx_idle_deadline = stamp->monotonic_us + option.timestamp_timeout * 1000ULL;
+    rx_idle_pending = true;
+}
+
+/* Received data went idle, next data starts a new timestamped line */
+static void tty_rx_gap(void)
+{
+    rx_idle_pending = false;
+
+    if (option.output_mode == OUTPUT_MODE_HEX)
+    {
+        hexdump_break();
+    }
+    else if (!next_timestamp)
+    {
+        rx_gap_break = true;
+        next_timestamp = true;
+    }
+}
+
+/* Handle inactivity timer expiry and return the time to wait [ms] for it,
+ * or -1 if it is not armed. */
+static int tty_rx_idle_timeout(void)
+{
+    if (!rx_idle_pending)
+    {
+        return -1;
+    }
+
+    if (monotonic_us() >= rx_idle_deadline)
+    {
+        /* Queued data is checked against its arrival time instead */
+        if (RING_Get_Count(rx_ring) == 0)
+        {
+            tty_rx_gap();
+            print_flush_arm();
         }
+        return -1;
+    }
+
+    return deadline_timeout(rx_idle_deadline);
+}
+
+/* Print at most BUFSIZ bytes of received data */
+static void tty_handle_rx_block(const char *buffer, size_t count, const timestamp_stamp_t *stamp)
+{
+    char mapped[BUFSIZ];
+    const char *data = buffer;
+    size_t i, j;
+
+    /* Translate input characters (MSB to LSB bit order) */
+    if (!map_rx.identity)
+    {
+        map_apply(&map_rx, mapped, buffer, count);
+        data = mapped;
     }
 
-    previous_char = input_char;
+    i = 0;
+    while (i < count)
+    {
+        bool line_start = next_timestamp && (option.output_mode == OUTPUT_MODE_NORMAL);
+
+        /* Print timestamp on new line if enabled */
+        if (line_start && (buffer[i] != '\n') && (buffer[i] != '\r'))
+        {
+            /* Data after inactivity timeout continues on a new line */
+            if (rx_gap_break && print_tainted)
+            {
+                printf("\r\n");
+                if (option.log)
+                {
+                    log_printf("\r\n");
+                }
+            }
+            rx_gap_break = false;
+
+            char *now = timestamp_format(stamp);
+            if (now)
+            {
+                ansi_printf_raw("[%s] ", now);
+                if (option.log)
+                {
+                    log_printf("[%s] ", now);
+                }
+                next_timestamp = false;
+                line_start = false;
+            }
+        }
+
+        /* Bytes needing attention are handled one at a time */
+        if (line_start || rx_is_special(data[i]))
+        {
+            rx_putc(data[i++]);
+            continue;
+        }
+
+        /* Everything up to the next special byte goes out in one block */
+        j = i + 1 + scan_chars(&rx_special, &data[i + 1], count - i - 1);
+        rx_write(&data[i], j - i);
+        i = j;
+    }
 }
 
-void stdin_restore(void)
+static void tty_handle_rx(const char *buffer, size_t count, const timestamp_stamp_t *stamp)
 {
-    // tcsetattr(STDIN_FILENO, TCSANOW, &stdin_old);
+    /* Mapping needs a bounded buffer, hand larger input over in pieces */
+    while (count > BUFSIZ)
+    {
+        tty_handle_rx_block(buffer, BUFSIZ, stamp);
+        buffer += BUFSIZ;
+        count -= BUFSIZ;
+    }
+    tty_handle_rx_block(buffer, count, stamp);
 }
 
-void stdin_configure(void)
+/* Print one chunk of data handed over by the reader thread, returns number
+ * of bytes printed or 0 if there is nothing queued */
+static ssize_t tty_rx_service_chunk(void)
 {
-    // int status;
+    const char *input_buffer;
+    timestamp_stamp_t stamp;
+    ssize_t bytes_read = tty_rx_peek(&input_buffer, BUFSIZ, &stamp);
 
-    // /* Save current stdin settings */
-    // if (tcgetattr(STDIN_FILENO, &stdin_old) < 0)
-    // {
-    //     tio_error_printf("Saving current stdin settings failed");
-    //     exit(EXIT_FAILURE);
-    // }
+    if (bytes_read <= 0)
+    {
+        return 0;
+    }
 
-    // /* Prepare new stdin settings */
-    HANDLE hConsole = GetStdHandle(STD_INPUT_HANDLE);
-    DWORD mode = 0;
-    GetConsoleMode(hConsole, &mode); //
+    /* Update receive statistics */
+    rx_total += bytes_read;
 
+    /* Inactivity timeout may have expired while data was queued */
+    if (rx_idle_pending && (stamp.monotonic_us >= rx_idle_deadline))
+    {
+        tty_rx_gap();
+    }
+    tty_rx_idle_arm(&stamp);
 
-    // /* Reconfigure stdin (RAW configuration) */
-    mode &=~ENABLE_ECHO_INPUT;
-    mode &=~ENABLE_LINE_INPUT;
-    mode &=~ENABLE_PROCESSED_INPUT;
-    mode |= ENABLE_VIRTUAL_TERMINAL_INPUT;
-    // /* Control characters */
-    // stdin_new.c_cc[VTIME] = 0; /* Inter-character timer unused */
-    // stdin_new.c_cc[VMIN]  = 1; /* Blocking read until 1 character received */
+    /* Process input in runs, timestamped with arrival time */
+    hexdump_stamp_set(&stamp);
+    tty_handle_rx(input_buffer, bytes_read, &stamp);
+    hexdump_stamp_set(NULL);
 
-    // /* Activate new stdin settings */
-    SetConsoleMode(hConsole, mode);
+    /* Next line may be sent when the device echoed or prompted */
+    if (option.output_line_sync != LINE_SYNC_NONE)
+    {
+        tty_tx_sync_rx(input_buffer, bytes_read);
+    }
+    tty_rx_release(bytes_read);
+    print_flush_arm();
 
-    // /* Make sure we restore old stdin settings on exit */
-    // atexit(&stdin_restore);
-}
+    tty_rx_dropped_check();
 
-void stdout_restore(void)
-{
-    // tcsetattr(STDOUT_FILENO, TCSANOW, &stdout_old);
+    return bytes_read;
 }
 
-void stdout_configure(void)
+/* Print data handed over by the reader thread. Work per call is bounded so
+ * continuous reception can't starve the other event sources, anything left
+ * keeps the ring readable and is serviced in the next loop iteration. */
+static void tty_rx_service(void)
 {
-    /* Disable line buffering in stdout. This is necessary if we
-     * want things like local echo to work correctly. */
-    setvbuf(stdout, NULL, _IONBF, 0);
-
-    HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-    DWORD mode = 0;
-    GetConsoleMode(hConsole, &mode); //
-    mode |= ENABLE_PROCESSED_OUTPUT;
-    mode |= ENABLE_VIRTUAL_TERMINAL_PROCESSING;
-    SetConsoleMode(hConsole, mode);
-
-    SetConsoleOutputCP(CP_UTF8);
-
-    /* At start use normal print function */
-    print = print_normal;
+    size_t budget = 0;
+    ssize_t bytes_read;
 
-    /* Make sure we restore old stdout settings on exit */
-    atexit(&stdout_restore);
+    do
+    {
+        bytes_read = tty_rx_service_chunk();
+        budget += bytes_read;
+    } while ((bytes_read > 0) && (budget < RX_SERVICE_BUDGET));
 }
 
-void tty_configure(void)
+/* Wait on the session poll set until a source is ready or the earliest
+ * deadline, then run due timers, print received data and feed the device.
+ * Callers pass their own deadlines in timeout and handle stdin from revents.
+ * before_rx, if set, is called before received data is printed. Returns the
+ * number of ready sources, 0 on timeout or -1 on failure. */
+static int tty_service(short revents[POLL_ID_END], int timeout, void (*before_rx)(void))
 {
-    sp_new_config(&cfgPort);
-    sp_new_config(&cfgPort_old);
-
-    /* Set speed */
-    sp_set_config_baudrate(cfgPort, option.baudrate);
+    int status;
 
-    /* Set databits */
-    sp_set_config_bits(cfgPort, option.databits);
+    timeout = timeout_min(timeout, tty_rx_idle_timeout());
+    timeout = timeout_min(timeout, tty_tx_timeout());
+    timeout = timeout_min(timeout, print_flush_timeout());
+    timeout = timeout_min(timeout, timer_timeout());
 
-    /* Set flow control */
-    if (strcmp("hard", option.flow) == 0)
-    {
-        sp_set_config_flowcontrol(cfgPort, SP_FLOWCONTROL_RTSCTS);
-    }
-    else if (strcmp("soft", option.flow) == 0)
-    {
-        sp_set_config_flowcontrol(cfgPort, SP_FLOWCONTROL_XONXOFF);
-    }
-    else if (strcmp("none", option.flow) == 0)
+    status = tty_poll(revents, timeout);
+    timer_run();
+    if (status < 0)
     {
-        sp_set_config_flowcontrol(cfgPort, SP_FLOWCONTROL_NONE);
+        tio_error_printf_silent("poll() failed (%s)", GetErrorMessage(GetLastError()));
+        return -1;
     }
-    else
+    if (status == 0)
     {
-        tio_error_printf("Invalid flow control");
-        exit(EXIT_FAILURE);
+        /* Timer due, handled when computing the next timeout */
+        print_flush();
+        return 0;
     }
 
-    /* Set stopbits */
-    sp_set_config_stopbits(cfgPort, option.stopbits);
-
-    /* Set parity */
-    if (strcmp("odd", option.parity) == 0)
-    {
-        sp_set_config_parity(cfgPort, SP_PARITY_ODD);
-    }
-    else if (strcmp("even", option.parity) == 0)
+    if (revents[POLL_ID_EXIT] & POLL_IN)
     {
-       sp_set_config_parity(cfgPort, SP_PARITY_EVEN);
+        /* Exit called */
+        exit(EXIT_SUCCESS);
     }
-    else if (strcmp("none", option.parity) == 0)
+
+    if (revents[POLL_ID_TTY] & POLL_IN)
     {
-        sp_set_config_parity(cfgPort, SP_PARITY_NONE);
+        if (before_rx != NULL)
+        {
+            before_rx();
+        }
+        tty_rx_service();
     }
-    else if ( strcmp("mark", option.parity) == 0)
+    else if (revents[POLL_ID_TTY_ERROR] & POLL_IN)
     {
-        sp_set_config_parity(cfgPort, SP_PARITY_MARK);
+        tio_error_printf_silent("Could not read from tty device");
+        return -1;
     }
-    else if ( strcmp("space", option.parity) == 0)
+
+    if (revents[POLL_ID_TTY_TX] & (POLL_OUT | POLL_ERR | POLL_HUP))
     {
-        sp_set_config_parity(cfgPort, SP_PARITY_SPACE);
+        /* Device is ready for more data */
+        tty_sync();
     }
-    else
+
+    return status;
+}
+
+#ifdef __linux__
+/* Piped input can be moved to the tty device by the kernel when it is sent
+ * unmodified and without pacing */
+static bool tty_forward_splice_possible(void)
+{
+    struct stat st;
+
+    return (fstat(STDIN_FILENO, &st) == 0) && S_ISFIFO(st.st_mode) &&
+           !tty_tx_paced() && (option.output_line_sync == LINE_SYNC_NONE);
+}
+
+/* Move up to count bytes from stdin pipe to tty device, returns bytes moved,
+ * 0 at end of input or -1 on failure */
+static ssize_t tty_forward_splice(size_t count)
+{
+    int fd;
+
+    if (sp_get_port_handle(hPort, &fd) != SP_OK)
     {
-        tio_error_printf("Invalid parity");
-        exit(EXIT_FAILURE);
+        errno = EINVAL;
+        return -1;
     }
 
-    /* Configure any specified input or output mappings */
-    char * buffer = strdup(option.map);
-    bool token_found = true;
-    char *token = NULL;
-    while (token_found == true)
+    return splice(STDIN_FILENO, NULL, fd, NULL, count, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+}
+#endif
+
+/* Forward piped stdin to the tty device in large chunks. Transmission
+ * follows the same flow control as the transmit queue and received data
+ * keeps being printed meanwhile. Returns 0 at end of input. */
+static int tty_forward_stdin(void)
+{
+    static char buffer[FORWARD_CHUNK_SIZE];
+    uint64_t start = monotonic_us(), elapsed;
+    unsigned long long forwarded = 0;
+    bool eof = false, stdin_polled = true;
+    int rc = 0;
+#ifdef __linux__
+    bool use_splice = tty_forward_splice_possible();
+#endif
+
+    while (!eof || (tx_count > 0))
     {
-        if (token == NULL)
+        short revents[POLL_ID_END];
+        bool stdin_wanted;
+
+        /* Stdin is only read while there is room to forward it */
+#ifdef __linux__
+        if (use_splice)
         {
-            token = strtok(buffer,",");
+            stdin_wanted = !eof && (tx_count == 0) && !tx_timer_armed && !tx_waiting;
         }
         else
+#endif
         {
-            token = strtok(NULL, ",");
+            stdin_wanted = !eof && (tx_count < TX_QUEUE_SIZE);
         }
 
-        if (token != NULL)
+        /* Stdin leaves the poll set while it is not read, a closed pipe
+         * would otherwise keep reporting a hang up */
+        if (stdin_wanted != stdin_polled)
         {
-            if (strcmp(token,"INLCR") == 0)
-            {
-                map_i_nl_cr = true;
-            }
-            else if (strcmp(token,"IGNCR") == 0)
-            {
-                map_ign_cr = true;
-            }
-            else if (strcmp(token,"ICRNL") == 0)
-            {
-                map_i_cr_nl = true;
-            }
-            else if (strcmp(token,"OCRNL") == 0)
-            {
-                map_o_cr_nl = true;
-            }
-            else if (strcmp(token,"ODELBS") == 0)
-            {
-                map_o_del_bs = true;
-            }
-            else if (strcmp(token,"IFFESCC") == 0)
+            if (stdin_wanted)
             {
-                map_i_ff_escc = true;
+                tty_poll_add(stdin_waitable(), POLL_IN, POLL_ID_STDIN, "stdin");
             }
-            else if (strcmp(token,"INLCRNL") == 0)
+            else
             {
-                map_i_nl_crnl = true;
+                tty_poll_remove(stdin_waitable(), POLL_ID_STDIN);
             }
-            else if (strcmp(token, "ONLCRNL") == 0)
+            stdin_polled = stdin_wanted;
+        }
+
+        int status = tty_service(revents, -1, NULL);
+        if (status < 0)
+        {
+            rc = -1;
+            break;
+        }
+
+        if (!stdin_wanted || !(revents[POLL_ID_STDIN] & (POLL_IN | POLL_HUP)))
+        {
+            continue;
+        }
+
+        ssize_t bytes_read;
+#ifdef __linux__
+        if (use_splice)
+        {
+            int outq = sp_output_waiting(hPort);
+            size_t room = (outq > 0) ? TX_OUTQ_LIMIT - MIN(outq, TX_OUTQ_LIMIT) : TX_OUTQ_LIMIT;
+
+            if (room == 0)
             {
-                map_o_nl_crnl = true;
+                tty_tx_throttle(outq, TX_OUTQ_LIMIT / 2);
+                continue;
             }
-            else if (strcmp(token, "OLTU") == 0)
+
+            bytes_read = tty_forward_splice(room);
+            if ((bytes_read < 0) && (errno == EAGAIN))
             {
-                map_o_ltu = true;
+                /* Device is full */
+                tty_tx_wait_set(true);
+                continue;
             }
-            else if (strcmp(token, "MSB2LSB") == 0)
+            if ((bytes_read < 0) && (errno == EINVAL))
             {
-                map_o_msblsb = true;
+                /* Not supported for this device, copy instead */
+                use_splice = false;
+                continue;
             }
-            else
+        }
+        else
+#endif
+        {
+            size_t room = TX_QUEUE_SIZE - tx_count;
+
+            bytes_read = stdin_read(buffer, MIN(room, sizeof(buffer)));
+            if (bytes_read > 0)
             {
-                printf("Error: Unknown mapping flag %s\n", token);
-                exit(EXIT_FAILURE);
+                /* Piped input is forwarded unmapped */
+                tty_tx_queue(buffer, bytes_read, false);
+                tty_sync();
             }
         }
-        else
+
+        if (bytes_read < 0)
         {
-            token_found = false;
+            tio_error_printf("Could not read from pipe (%s)", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        if (bytes_read == 0)
+        {
+            eof = true;
         }
+
+        forwarded += bytes_read;
+        tx_total += bytes_read;
     }
-    free(buffer);
+
+    if (!stdin_polled)
+    {
+        tty_poll_add(stdin_waitable(), POLL_IN, POLL_ID_STDIN, "stdin");
+    }
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    /* Include transmission time of what is still in the driver */
+    tty_drain();
+
+    elapsed = monotonic_us() - start;
+    tio_printf("Forwarded %llu bytes in %.3f s (%.0f bytes/s)", forwarded, elapsed / 1000000.0,
+               elapsed ? forwarded * 1000000.0 / elapsed : 0.0);
+
+    return 0;
 }
 
-void tty_wait_for_device(void)
+static bool send_progress_shown = false;
+
+/* Received data goes below the progress line */
+static void tty_send_progress_break(void)
 {
-    int    status;
-    int    timeout;
-    static char input_char;
-    static bool first = true;
-    static DWORD last_errno = 0;
+    if (send_progress_shown)
+    {
+        printf("\r\n");
+        send_progress_shown = false;
+    }
+}
 
-    /* Loop until device pops up */
-    while (true)
+/* Print raw file send progress on a line of its own, which is overwritten by
+ * the next update unless received data was printed in between */
+static void tty_send_progress(unsigned long long sent, unsigned long long total, uint64_t elapsed, bool cts_low)
+{
+    double rate = elapsed ? sent * 1000000.0 / elapsed : 0.0;
+    char eta[32] = "-";
+
+    if ((rate > 0) && (sent < total))
     {
-        if (interactive_mode)
+        snprintf(eta, sizeof(eta), "%.0f s", (total - sent) / rate);
+    }
+
+    putchar('\r');
+    tio_printf_raw("Sent %llu/%llu bytes (%u%%) %.0f bytes/s ETA %s%s   ", sent, total,
+                   total ? (unsigned int) (sent * 100 / total) : 100, rate, eta,
+                   cts_low ? " waiting for CTS" : "");
+    fflush(stdout);
+    send_progress_shown = true;
+}
+
+/* Stream a file unmodified to the tty device. Optionally chunk_size bytes
+ * are sent at a time with a pause of chunk_delay ms once each chunk has left
+ * the transmit queue. Received data keeps being printed and any key aborts
+ * the transfer. Returns 0 on success, -1 on failure or abort. */
+int tty_send_file(const char *filename, size_t chunk_size, unsigned int chunk_delay)
+{
+    int fd;
+    struct stat st;
+    const char *data;
+    size_t length, queued = 0, chunk_left = chunk_size;
+    unsigned long long sent;
+    uint64_t start, now, chunk_due = 0, progress_due = 0;
+    bool chunk_pause = false, cts_low = false, aborted = false;
+    bool hard_flow = (strcmp(option.flow, "hard") == 0);
+    line_sync_t line_sync = option.output_line_sync;
+    int line_delay = option.output_line_delay;
+    int rc = 0;
+
+    fd = open(filename, O_RDONLY | O_BINARY);
+    if (fd < 0)
+    {
+        tio_error_print("Could not open file '%s' (%s)", filename, strerror(errno));
+        return -1;
+    }
+    if (fstat(fd, &st) < 0)
+    {
+        tio_error_print("Could not stat file '%s' (%s)", filename, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    length = st.st_size;
+    data = (length > 0) ? mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    if ((length > 0) && ((data == NULL) || (data == MAP_FAILED)))
+    {
+        tio_error_print("Could not mmap file '%s'", filename);
+        close(fd);
+        return -1;
+    }
+
+    /* Binary data has no lines, only character pacing applies */
+    option.output_line_sync = LINE_SYNC_NONE;
+    option.output_line_delay = 0;
+
+    start = monotonic_us();
+
+    while ((queued < length) || (tx_count > 0))
+    {
+        short revents[POLL_ID_END];
+        int timeout;
+
+        now = monotonic_us();
+
+        /* Pause between chunks starts when the chunk has left the queue */
+        if (chunk_size && (chunk_left == 0) && (tx_count == 0))
         {
-            /* In interactive mode, while waiting for tty device, we need to
-             * read from stdin to react on input key commands. */
-            if (first)
+            if (!chunk_pause)
             {
-                /* Don't wait first time */
-                timeout = 0;
-                first = false;
+                chunk_due = now + chunk_delay * 1000ULL;
+                chunk_pause = true;
             }
-            else
+            if (now >= chunk_due)
             {
-                /* Wait up to 1 second for input */
-                timeout = 1000;
+                chunk_left = chunk_size;
+                chunk_pause = false;
             }
+        }
 
-            pollfd_t pollfd[2];
-            pollfd[0].fd = RING_GetWaitable(ring, RING_Available);
-            pollfd[0].events = POLL_IN;
-            pollfd[1].fd = ev_exit;
-            pollfd[1].events = POLL_IN;
-
-            /* Block until input becomes available or timeout */
-            status = poll(pollfd, 2, timeout);
-            if (status > 0)
-            {
-                /* Input from stdin ready */
-                if (pollfd[0].revents & POLL_IN)
-                {
-                    /* Read one character */
-                    status = RING_Read(ring, &input_char, 1);
-                    if (status == 0)
-                    {
-                        tio_error_printf("Could not read from stdin");
-                        exit(EXIT_FAILURE);
-                    }
+        /* Queue more unless paused or the device signals it can't take it */
+        if (hard_flow)
+        {
+            enum sp_signal signals;
+            cts_low = (sp_get_signals(hPort, &signals) == SP_OK) && !(signals & SP_SIG_CTS);
+        }
+        if ((queued < length) && (tx_count < TX_QUEUE_SIZE) && !cts_low && (!chunk_size || (chunk_left > 0)))
+        {
+            size_t n = MIN(length - queued, (size_t) (TX_QUEUE_SIZE - tx_count));
 
-                    /* Handle commands */
-                    handle_command_sequence(input_char, NULL, NULL);
-                }
-                /* Exit called */
-                else if (pollfd[1].revents == POLL_IN)
-                {
-                    exit(EXIT_SUCCESS);
-                }
-            }
-            else if (status == -1)
+            if (chunk_size)
             {
-                tio_error_printf("poll() failed (%s)", GetErrorMessage(GetLastError()));
-                exit(EXIT_FAILURE);
+                n = MIN(n, chunk_left);
+                chunk_left -= n;
             }
+            tty_tx_queue(&data[queued], n, false);
+            tty_sync();
+            queued += n;
         }
 
-        /* Open tty device */
-        if (sp_get_port_by_name(option.tty_device, &hPort) == SP_OK)
+        if (now >= progress_due)
         {
-            if (sp_open(hPort, SP_MODE_READ_WRITE) == SP_OK)
-            {
-                last_errno = 0;
-                return;
-            }
-            else
-            {
-                sp_free_port(hPort);
-            }
+            tty_send_progress(queued - tx_count, length, now - start, cts_low);
+            progress_due = now + SEND_PROGRESS_INTERVAL * 1000ULL;
         }
 
-        if (last_errno != GetLastError())
+        timeout = deadline_timeout(progress_due);
+        if (chunk_pause)
         {
-            tio_warning_printf("Could not open tty device (%s)", GetErrorMessage(GetLastError()));
-            tio_printf("Waiting for tty device..");
-            last_errno = GetLastError();
+            timeout = timeout_min(timeout, deadline_timeout(chunk_due));
+        }
+        if (cts_low)
+        {
+            // No event for modem line changes, check again shortly
+            timeout = timeout_min(timeout, 10);
         }
 
-        if (!interactive_mode)
+        int status = tty_service(revents, timeout, tty_send_progress_break);
+        if (status < 0)
         {
-            /* In non-interactive mode we do not need to handle input key
-             * commands so we simply sleep 1 second between checking for
-             * presence of tty device */
-            sleep(1);
+            rc = -1;
+            break;
         }
-    }
-}
 
-void tty_disconnect(void)
-{
-    if (InterlockedCompareExchange(&connected, false, true))
-    {
-        tio_printf("Disconnected");
+        if (revents[POLL_ID_STDIN] & (POLL_IN | POLL_HUP))
+        {
+            char key[16];
 
-        sp_close(hPort);
-        sp_free_port(hPort);
+            /* Any key aborts */
+            stdin_read(key, sizeof(key));
+            aborted = true;
+            rc = -1;
+            break;
+        }
+    }
 
-        /* Fire alert action */
-        alert_disconnect();
+    sent = queued - tx_count;
+    tx_total += sent;
+
+    if (rc < 0)
+    {
+        /* Drop what was not handed over to the driver yet */
+        tx_count = 0;
+        tx_timer_armed = false;
+        tty_tx_wait_set(false);
+    }
+    else
+    {
+        tty_drain();
     }
-}
 
-void tty_restore(void)
-{
-    sp_set_config(hPort, cfgPort_old);
+    option.output_line_sync = line_sync;
+    option.output_line_delay = line_delay;
 
-    if (connected)
+    now = monotonic_us();
+    tty_send_progress(sent, length, now - start, false);
+    tty_send_progress_break();
+    tio_printf("%s, sent %llu bytes in %.3f s", aborted ? "Aborted" : (rc < 0) ? "Failed" : "Done",
+               sent, (now - start) / 1000000.0);
+
+    if (data != NULL)
     {
-        tty_disconnect();
+        munmap((void *) data, length);
     }
+    close(fd);
+
+    return rc;
 }
 
-void forward_to_tty(char output_char)
+/* Handle keys typed on stdin: key commands, line and hex input modes and
+ * forwarding to tty. Returns -1 if stdin could not be read. */
+static int tty_stdin_service(void)
 {
-    int status;
+    char input_buffer[BUFSIZ];
+    char input_char, output_char;
+    bool forward;
 
-    /* Map output character */
-    if ((output_char == 127) && (map_o_del_bs))
-    {
-        output_char = '\b';
-    }
-    if ((output_char == '\r') && (map_o_cr_nl))
+    ssize_t bytes_read = stdin_read(input_buffer, BUFSIZ);
+    if (bytes_read <= 0)
     {
-        output_char = '\n';
+        return -1;
     }
 
-    /* Map newline character */
-    if ((output_char == '\n' || output_char == '\r') && (map_o_nl_crnl))
+    /* Process input byte by byte */
+    for (int i=0; i<bytes_read; i++)
     {
-        const char *crlf = "\r\n";
-
-        optional_local_echo(crlf[0]);
-        optional_local_echo(crlf[1]);
-        status = tty_write(crlf, 2);
-        if (status < 0)
+        /* Runs without prefix key are forwarded in bulk, only
+         * key command sequences are parsed byte by byte */
+        if (interactive_mode && command_sequence_idle() &&
+            (((option.input_mode == INPUT_MODE_NORMAL) && (option.output_mode == OUTPUT_MODE_NORMAL)) ||
+             (option.input_mode == INPUT_MODE_HEX)))
         {
-            tio_warning_printf("Could not write to tty device");
-        }
+            const char *prefix = NULL;
+            size_t run;
 
-        tx_total += 2;
-    }
-    else
-    {
-        switch (option.output_mode)
-        {
-            case OUTPUT_MODE_NORMAL:
-                if (option.input_mode == INPUT_MODE_HEX)
+            if (option.prefix_enabled)
+            {
+                prefix = memchr(&input_buffer[i], option.prefix_code, bytes_read - i);
+            }
+            run = prefix ? (size_t) (prefix - &input_buffer[i]) : (size_t) (bytes_read - i);
+
+            if (option.input_mode == INPUT_MODE_HEX)
+            {
+                /* Single keystrokes keep the interactive prompt */
+                if (run > 1)
                 {
-                    handle_hex_prompt(output_char);
+                    forward_hex_run_to_tty(&input_buffer[i], run);
+                    i += run - 1;
+                    continue;
                 }
-                else
-                {
-                    /* Send output to tty device */
-                    optional_local_echo(output_char);
-                    if ((output_char == 0) && (map_o_nulbrk))
-                    {
-                        sp_start_break(hPort);
-                        delay(100);
-                        sp_end_break(hPort);
-                    }
-                    else
-                    {
-                        status = tty_write(&output_char, 1);
-                    }
-                    if (status < 0)
-                    {
-                        tio_warning_printf("Could not write to tty device");
-                    }
+            }
+            else if (run > 0)
+            {
+                forward_run_to_tty(&input_buffer[i], run);
+                i += run - 1;
+                continue;
+            }
+        }
 
-                    /* Update transmit statistics */
-                    tx_total++;
-                }
-                break;
+        input_char = input_buffer[i];
 
-            case OUTPUT_MODE_HEX:
-                if (option.input_mode == INPUT_MODE_HEX)
-                {
-                    handle_hex_prompt(output_char);
-                }
-                else
+        /* Forward input to output */
+        output_char = input_char;
+        forward = true;
+
+        if (interactive_mode)
+        {
+            /* Do not forward prefix key */
+            if (option.prefix_enabled && input_char == option.prefix_code)
+            {
+                forward = false;
+            }
+
+            /* Handle commands */
+            handle_command_sequence(input_char, &output_char, &forward);
+
+            if (forward)
+            {
+                switch (option.input_mode)
                 {
-                    optional_local_echo(output_char);
+                    case INPUT_MODE_HEX:
+                        if (!is_valid_hex(input_char))
+                        {
+                            tio_warning_printf("Invalid hex character: '%d' (0x%02x)", input_char, input_char);
+                            forward = false;
+                        }
+                        break;
+
+                    case INPUT_MODE_LINE:
+                        switch (input_char)
+                        {
+                            case 27: // Escape
+                                forward = false;
+                                break;
+
+                            case '[':
+                                if (input_previous_char[0] == 27)
+                                {
+                                    forward = false;
+                                }
+                                break;
+
+                            case 'A':
+                            case 'B':
+                            case 'C':
+                            case 'D':
+                                if ((input_previous_char[1] == 27) && (input_previous_char[0] == '['))
+                                {
+                                    // Handle arrow keys
+                                    switch (input_char)
+                                    {
+                                        case 'A': // Up arrow
+                                            // Ignore
+                                            break;
+                                        case 'B': // Down arrow
+                                            // Ignore
+                                            break;
+                                        case 'C': // Right arrow
+                                            // Ignore
+                                            break;
+                                        case 'D': // Left arrow
+                                            // Ignore
+                                            break;
+                                    }
+                                    forward = false;
+                                }
+                                break;
+
+                            case '\b':
+                            case 127: // Backspace
+                                if (line_index)
+                                {
+                                    if ((option.output_mode == OUTPUT_MODE_HEX) && (option.local_echo))
+                                    {
+                                        printf("\b\b\b   \b\b\b"); // Destructive backspace
+                                    }
+                                    else
+                                    {
+                                        printf("\b \b"); // Destructive backspace
+                                    }
+                                    line_index--;
+                                }
+                                forward = false;
+                                break;
+
+                            case 13: // Carriage return
+                                // Write buffered line to tty device
+                                tty_write(line_buffer, line_index);
+                                tty_write("\r", 1);
+                                print('\r');
+                                tty_sync();
+                                putchar('\r');
+                                putchar('\n');
+                                line_index = 0;
+                                forward = false;
+                                break;
+
+                            default:
+                                if (line_index < BUFSIZ)
+                                {
+                                    print(input_char);
+                                    line_buffer[line_index++] = input_char;
+                                }
+                                else
+                                {
+                                    tio_error_print("Input exceeds maximum line length. Truncating.");
+                                }
+                                forward = false;
+                        }
+
+                        // Save 2 latest stdin input characters
+                        input_previous_char[1] = input_previous_char[0];
+                        input_previous_char[0] = input_char;
+
+                        break;
+
+                    default:
+                        break;
                 }
-                break;
+            }
+        }
 
-            case OUTPUT_MODE_END:
-                break;
+        if (forward)
+        {
+            forward_to_tty(output_char);
         }
     }
+
+    tty_sync();
+
+    /* Keep echo and command output snappy */
+    print_flush();
+
+    return 0;
 }
 
 int tty_connect(void)
 {
-    char   input_char, output_char;
-    char   input_buffer[BUFSIZ] = {};
-    char   line_buffer[BUFSIZ] = {};
     static bool first = true;
     int    status;
-    bool   next_timestamp = false;
-    char*  now = NULL;
-    unsigned int line_index = 0;
-    bool ignore_stdin = false;
-    static char previous_char[2] = {};
 
     /* Flush stale I/O data (if any) */
     sp_drain(hPort);
@@ -1283,10 +3538,10 @@ int tty_connect(void)
     /* Fire alert action */
     alert_connect();
 
-    if (option.timestamp)
-    {
-        next_timestamp = true;
-    }
+    next_timestamp = (option.timestamp != TIMESTAMP_NONE);
+    line_index = 0;
+    rx_idle_pending = false;
+    rx_gap_break = false;
 
     /* Manage print output mode */
     tty_output_mode_set(option.output_mode);
@@ -1317,39 +3572,36 @@ int tty_connect(void)
     sp_new_event_set(&sp_event);
     sp_add_port_events(sp_event, hPort, SP_EVENT_RX_READY);
 
+    /* Transmit queue is serviced when the device is ready for more data */
+    if(sp_tx_event)
+        sp_free_event_set(sp_tx_event);
+    sp_new_event_set(&sp_tx_event);
+    sp_add_port_events(sp_tx_event, hPort, SP_EVENT_TX_READY);
+    tx_waitable = ((WAIT_HANDLE*)sp_tx_event->handles)[0];
+    tx_head = 0;
+    tx_count = 0;
+    tx_timer_armed = false;
+    tx_waiting = false;
+    tty_tx_sync_done();
+
+    /* Received data is handed over by the reader thread */
+    tty_rx_thread_start();
+
     /* If stdin is a pipe forward all input to tty device */
     if (interactive_mode == false)
     {
-        while (true)
+        if (tty_forward_stdin() < 0)
         {
-            int ret = RING_Read_Blocking(ring, &input_char, 1);
-            if (ret < 0)
-            {
-                tio_error_printf("Could not read from pipe (%s)", strerror(errno));
-                exit(EXIT_FAILURE);
-            }
-            else if (ret > 0)
-            {
-                // Forward to tty device
-                ret = sp_blocking_write(hPort, &input_char, 1, 0);
-                if (ret < 0)
-                {
-                    tio_error_printf("Could not write to serial device (%s)", strerror(errno));
-                    exit(EXIT_FAILURE);
-                }
-            }
-            else
-            {
-                // EOF - finished forwarding
-                break;
-            }
+            goto error_read;
         }
     }
 
     /* Manage script activation */
     if (option.script_run != SCRIPT_RUN_NEVER)
     {
+        tty_drain();
         script_run(hPort);
+        tty_tx_sync_prompt_compile();
 
         if (option.script_run == SCRIPT_RUN_ONCE)
         {
@@ -1366,283 +3618,26 @@ int tty_connect(void)
     /* Input loop */
     while (true)
     {
-        pollfd_t pollfd[3];
-        if (!ignore_stdin)
-        {
-            pollfd[2].fd = RING_GetWaitable(ring, RING_Available);
-            pollfd[2].events = POLL_IN;
-        }
-        else
+        short revents[POLL_ID_END];
+
+        /* Every ready source is serviced in each iteration, each with a
+         * bounded amount of work, so keystrokes are not starved by
+         * heavy inbound traffic */
+        status = tty_service(revents, -1, NULL);
+        if (status < 0)
         {
-            pollfd[2].fd = 0;
-            pollfd[2].events = 0;
-            pollfd[2].revents = 0;
+            goto error_read;
         }
-        pollfd[0].fd = ((HANDLE*)sp_event->handles)[0];
-        pollfd[0].events = POLL_IN;
-        pollfd[1].fd = ev_exit;
-        pollfd[1].events = POLL_IN;
 
-        /* Block until input becomes available */
-        status = poll(pollfd, ignore_stdin ? 2 : 3, -1);
-        if (status > 0)
+        if (revents[POLL_ID_STDIN] & (POLL_IN | POLL_HUP))
         {
-            bool forward = false;
-            if (pollfd[1].revents == POLL_IN)
-            {
-                /* Exit called */
-                exit(EXIT_SUCCESS);
-            }
-            else if (pollfd[0].revents == POLL_IN)
-            {
-                /* Input from tty device ready */
-                ssize_t bytes_read = sp_nonblocking_read(hPort, input_buffer, BUFSIZ);
-                if (bytes_read < 0)
-                {
-                    /* Error reading - device is likely unplugged */
-                    tio_error_printf_silent("Could not read from tty device");
-                    goto error_read;
-                }
-
-                /* Update receive statistics */
-                rx_total += bytes_read;
-
-                /* Process input byte by byte */
-                for (int i=0; i<bytes_read; i++)
-                {
-                    input_char = input_buffer[i];
-
-                    /* Print timestamp on new line if enabled */
-                    if ((next_timestamp && input_char != '\n' && input_char != '\r') && (option.output_mode == OUTPUT_MODE_NORMAL))
-                    {
-                        now = timestamp_current_time();
-                        if (now)
-                        {
-                            ansi_printf_raw("[%s] ", now);
-                            if (option.log)
-                            {
-                                log_printf("[%s] ", now);
-                            }
-                            next_timestamp = false;
-                        }
-                    }
-
-                    /* Convert MSB to LSB bit order */
-                    if (map_o_msblsb)
-                    {
-                        char ch = input_char;
-                        input_char = 0;
-                        for (int j = 0; j < 8; ++j)
-                        {
-                            input_char |= ((1 << j) & ch) ? (1 << (7 - j)) : 0;
-                        }
-                    }
-
-                    /* Map input character */
-                    if ((input_char == '\n') && (map_i_nl_crnl) && (!map_o_msblsb))
-                    {
-                        print('\r');
-                        print('\n');
-                        if (option.timestamp)
-                        {
-                            next_timestamp = true;
-                        }
-                    }
-                    else if ((input_char == '\f') && (map_i_ff_escc) && (!map_o_msblsb))
-                    {
-                        print('\e');
-                        print('c');
-                    }
-                    else
-                    {
-                        /* Print received tty character to stdout */
-                        print(input_char);
-                    }
-
-                    /* Write to log */
-                    if (option.log)
-                    {
-                        log_putc(input_char);
-                    }
-
-                    //socket_write(input_char);
-
-                    print_tainted = true;
-
-                    if (input_char == '\n' && option.timestamp)
-                    {
-                        next_timestamp = true;
-                    }
-                }
-            }
-            else if (pollfd[2].revents == POLL_IN)
-            {
-                /* Input from stdin ready */
-                ssize_t bytes_read = RING_Read(ring, input_buffer, BUFSIZ);
-                if (bytes_read == 0)
-                {
-                    tio_error_printf_silent("Could not read from stdin");
-                    goto error_read;
-                }
-
-                /* Process input byte by byte */
-                for (int i=0; i<bytes_read; i++)
-                {
-                    input_char = input_buffer[i];
-
-                    /* Forward input to output */
-                    output_char = input_char;
-                    forward = true;
-
-                    if (interactive_mode)
-                    {
-                        /* Do not forward prefix key */
-                        if (option.prefix_enabled && input_char == option.prefix_code)
-                        {
-                            forward = false;
-                        }
-
-                        /* Handle commands */
-                        handle_command_sequence(input_char, &output_char, &forward);
-
-                        if (forward)
-                        {
-                            switch (option.input_mode)
-                            {
-                                case INPUT_MODE_HEX:
-                                    if (!is_valid_hex(input_char))
-                                    {
-                                        tio_warning_printf("Invalid hex character: '%d' (0x%02x)", input_char, input_char);
-                                        forward = false;
-                                    }
-                                    break;
-
-                                case INPUT_MODE_LINE:
-                                    switch (input_char)
-                                    {
-                                        case 27: // Escape
-                                            forward = false;
-                                            break;
-
-                                        case '[':
-                                            if (previous_char[0] == 27)
-                                            {
-                                                forward = false;
-                                            }
-                                            break;
-
-                                        case 'A':
-                                        case 'B':
-                                        case 'C':
-                                        case 'D':
-                                            if ((previous_char[1] == 27) && (previous_char[0] == '['))
-                                            {
-                                                // Handle arrow keys
-                                                switch (input_char)
-                                                {
-                                                    case 'A': // Up arrow
-                                                        // Ignore
-                                                        break;
-                                                    case 'B': // Down arrow
-                                                        // Ignore
-                                                        break;
-                                                    case 'C': // Right arrow
-                                                        // Ignore
-                                                        break;
-                                                    case 'D': // Left arrow
-                                                        // Ignore
-                                                        break;
-                                                }
-                                                forward = false;
-                                            }
-                                            break;
-
-                                        case '\b':
-                                        case 127: // Backspace
-                                            if (line_index)
-                                            {
-                                                if ((option.output_mode == OUTPUT_MODE_HEX) && (option.local_echo))
-                                                {
-                                                    printf("\b\b\b   \b\b\b"); // Destructive backspace
-                                                }
-                                                else
-                                                {
-                                                    printf("\b \b"); // Destructive backspace
-                                                }
-                                                line_index--;
-                                            }
-                                            forward = false;
-                                            break;
-
-                                        case 13: // Carriage return
-                                            // Write buffered line to tty device
-                                            tty_write(line_buffer, line_index);
-                                            tty_write("\r", 1);
-                                            print('\r');
-                                            tty_sync();
-                                            putchar('\r');
-                                            putchar('\n');
-                                            line_index = 0;
-                                            forward = false;
-                                            break;
-
-                                        default:
-                                            if (line_index < BUFSIZ)
-                                            {
-                                                print(input_char);
-                                                line_buffer[line_index++] = input_char;
-                                            }
-                                            else
-                                            {
-                                                tio_error_print("Input exceeds maximum line length. Truncating.");
-                                            }
-                                            forward = false;
-                                    }
-
-                                    // Save 2 latest stdin input characters
-                                    previous_char[1] = previous_char[0];
-                                    previous_char[0] = input_char;
-
-                                    break;
-
-                                default:
-                                    break;
-                            }
-                        }
-                    }
-
-                    if (forward)
-                    {
-                        forward_to_tty(output_char);
-                    }
-                }
-
-                tty_sync(hPort);
-            }
-            else
+            /* Input from stdin ready */
+            if (tty_stdin_service() < 0)
             {
-                /* Input from socket ready */
-                // forward = socket_handle_input(&rdfs, &output_char);
-
-                // if (forward)
-                // {
-                //     forward_to_tty(hPort, output_char);
-                // }
-
-                // tty_sync(hPort);
+                tio_error_printf_silent("Could not read from stdin");
+                goto error_read;
             }
         }
-        else if (status == -1)
-        {
-
-            tio_error_printf("poll() failed (%s)", GetErrorMessage(GetLastError()));
-            exit(EXIT_FAILURE);
-        }
-        else
-        {
-            // Timeout (only happens in response wait mode)
-            exit(EXIT_FAILURE);
-        }
     }
 
     return TIO_SUCCESS;
@@ -1659,6 +3654,7 @@ error_read:
 
 void list_serial_devices(void)
 {
+#ifdef _WIN32
     char portName[MAX_PORT_NUM][MAX_STR_LEN];
     char friendlyName[MAX_PORT_NUM][MAX_STR_LEN];
     unsigned int i;
@@ -1675,4 +3671,19 @@ void list_serial_devices(void)
 
     for (i = 0; i < n; i++)
         printf(TEXT("%s\t <%s> \n"), &portName[i][0], &friendlyName[i][0]);
+#else
+    DIR *d = opendir(PATH_SERIAL_DEVICES);
+    if (d)
+    {
+        struct dirent *dir;
+        while ((dir = readdir(d)) != NULL)
+        {
+            if ((strcmp(dir->d_name, ".")) && (strcmp(dir->d_name, "..")))
+            {
+                printf("%s%s\n", PATH_SERIAL_DEVICES, dir->d_name);
+            }
+        }
+        closedir(d);
+    }
+#endif
 }
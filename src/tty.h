@@ -22,6 +22,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <sys/types.h>
 
 #define LINE_HIGH true
 #define LINE_LOW false
@@ -41,6 +42,11 @@ void tty_input_thread_create(void);
 void tty_input_thread_wait_ready(void);
 void tty_line_set(int mask, int value);
 void tty_line_toggle(int mask);
+ssize_t tty_read(void *buffer, size_t count, int timeout);
+void tty_read_flush(void);
+size_t tty_tx_pending(void);
+void tty_drain(void);
+int tty_send_file(const char *filename, size_t chunk_size, unsigned int chunk_delay);
 
 #define TIOCM_DTR 0x01
 #define TIOCM_RTS 0x02
@@ -19,6 +19,7 @@
 #include "serialport.h"
 #include "xymodem.h"
 #include "print.h"
+#include "tty.h"
 #include "mmap.h"
 
 #define SOH 0x01
@@ -87,7 +88,7 @@ static int xmodem_1k(struct sp_port *port, const void *data, size_t len, int seq
     while(1) {
         if (key_hit)
             return -1;
-        ret = sp_blocking_read(port, &resp, 1, 50);
+        ret = tty_read(&resp, 1, 50);
         if(ret < 0) {
             perror("Read sync from serial failed");
             return ERR;
@@ -98,8 +99,10 @@ static int xmodem_1k(struct sp_port *port, const void *data, size_t len, int seq
         }
     }
 
-    /* Clear all 'C' */
-    sp_flush(port, SP_BUF_BOTH);
+    /* Clear all 'C', input belongs to the reader thread and is dropped
+     * from its queue */
+    sp_flush(port, SP_BUF_OUTPUT);
+    tty_read_flush();
 
     /* Always work with 1K packets */
     packet.seq  = seq;
@@ -144,7 +147,7 @@ static int xmodem_1k(struct sp_port *port, const void *data, size_t len, int seq
         for(int n=0; n < 20; n++) {
             if (key_hit)
                 return ERR;
-            ret = sp_blocking_read(port, &resp, 1, 50);
+            ret = tty_read(&resp, 1, 50);
             if(ret < 0) {
                 perror("Read sync from serial failed");
                 return ERR;
@@ -180,7 +183,7 @@ static int xmodem_1k(struct sp_port *port, const void *data, size_t len, int seq
         }
         write(STDOUT_FILENO, "|", 1);
         usleep(1000000); /* 1 s timeout*/
-        ret = sp_blocking_read(port, &resp, 1, 50);
+        ret = tty_read(&resp, 1, 50);
         if(ret < 0) {
             perror("Read sync from serial failed");
             return ERR;
@@ -207,7 +210,7 @@ static int xmodem(struct sp_port *port, const void *data, size_t len)
     while(1) {
         if (key_hit)
             return -1;
-        ret = sp_blocking_read(port, &resp, 1, 50);
+        ret = tty_read(&resp, 1, 50);
         if(ret < 0) {
             perror("Read sync from serial failed");
             return ERR;
@@ -218,8 +221,10 @@ static int xmodem(struct sp_port *port, const void *data, size_t len)
         }
     }
 
-    /* Clear all 'C' */
-    sp_flush(port, SP_BUF_BOTH);
+    /* Clear all 'C', input belongs to the reader thread and is dropped
+     * from its queue */
+    sp_flush(port, SP_BUF_OUTPUT);
+    tty_read_flush();
 
     /* Always work with 128b packets */
     packet.seq  = 1;
@@ -262,7 +267,7 @@ static int xmodem(struct sp_port *port, const void *data, size_t len)
         for(int n=0; n < 20; n++) {
             if (key_hit)
                 return ERR;
-            ret = sp_blocking_read(port, &resp, 1, 50);
+            ret = tty_read(&resp, 1, 50);
             if(ret < 0) {
                 perror("Read sync from serial failed");
                 return ERR;
@@ -298,7 +303,7 @@ static int xmodem(struct sp_port *port, const void *data, size_t len)
         }
         write(STDOUT_FILENO, "|", 1);
         /* 1 s timeout*/
-        ret = sp_blocking_read(port, &resp, 1, 1000);
+        ret = tty_read(&resp, 1, 1000);
         if(ret < 0) {
             perror("Read sync from serial failed");
             return ERR;
@@ -0,0 +1,53 @@
+/*
+ * tio - a serial device I/O tool
+ *
+ * Copyright (c) 2014-2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Shared helpers of the microbenchmarks. Every benchmark prints the same
+ * CSV, one measurement per line, so results of all of them can be
+ * collected and diffed together:
+ *
+ *   benchmark,case,metric,value,unit
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+static inline uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void bench_header(void)
+{
+    printf("benchmark,case,metric,value,unit\n");
+}
+
+static inline void bench_report(const char *benchmark, const char *name, const char *metric, double value, const char *unit)
+{
+    printf("%s,%s,%s,%.1f,%s\n", benchmark, name, metric, value, unit);
+    fflush(stdout);
+}
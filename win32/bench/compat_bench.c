@@ -0,0 +1,481 @@
+/*
+ * tio - a serial device I/O tool
+ *
+ * Copyright (c) 2014-2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Throughput and hand-off latency of the posix_compat primitives every
+ * received and typed byte goes through: ring buffer (locked and SPSC),
+ * FIFO and semaphore, with one or several producers feeding a single
+ * consumer.
+ *
+ * Each case runs twice. The saturated pass lets the producers push as
+ * fast as they can and only gives the hand-off rate, its latency would be
+ * queueing delay. The paced pass keeps a single message in flight, each
+ * message carries its send time and the consumer records the delay until
+ * it got hold of it, which gives the p50/p99 hand-off latency.
+ *
+ * The poll cases measure how fast a waiter wakes up on a semaphore
+ * waitable: through a persistent POLL set (epoll on Linux) against a
+ * pollfd array handed to poll() on each wait (the emulated path on
+ * Windows).
+ *
+ * Usage: compat_bench [-p] [-n messages] [ring|fifo|sem|poll]...
+ *   -p  pin consumer and producers to separate CPUs when possible (Linux)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+# include <sched.h>
+#endif
+#include "cthread.h"
+#include "ring.h"
+#include "fifo.h"
+#include "pool.h"
+#include "mpmc.h"
+#include "semaphore.h"
+#include "cpoll.h"
+#include "bench.h"
+
+#define MESSAGES_DEFAULT 200000
+#define PRODUCERS_MAX    16
+#define MESSAGE_SIZE_MAX 4096
+#define RING_SIZE        (256 * 1024)
+#define FIFO_LENGTH      1024
+
+typedef enum
+{
+    BENCH_RING_LOCKED,
+    BENCH_RING_SPSC,
+    BENCH_FIFO,
+    BENCH_SEM,
+    BENCH_POLL_SET,
+    BENCH_POLL_ARRAY,
+} bench_kind_t;
+
+typedef struct
+{
+    bench_kind_t kind;
+    int producers;
+    size_t size;
+    size_t messages;
+    RING_Handle_t ring;
+    FIFO_Handle_t fifo;
+    POOL_Handle_t pool;
+    SEM_Handle_t sem;
+    MPMC_Queue_t stamps;
+    /* Paced pass, producers wait for the consumer to ack each message */
+    SEM_Handle_t ack;
+    uint64_t *latency;
+} bench_t;
+
+typedef struct
+{
+    bench_t *bench;
+    int index;
+} producer_t;
+
+static bool pin = false;
+#ifdef __linux__
+static int cpus[CPU_SETSIZE];
+static int cpu_count = 0;
+#endif
+
+/* Consumer goes on the first allowed CPU, producers on the following ones */
+static void pin_thread(int slot)
+{
+#ifdef __linux__
+    cpu_set_t set;
+
+    if (!pin || (cpu_count == 0))
+    {
+        return;
+    }
+
+    CPU_ZERO(&set);
+    CPU_SET(cpus[slot % cpu_count], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void) slot;
+#endif
+}
+
+static void *producer(void *arg)
+{
+    producer_t *p = arg;
+    bench_t *bench = p->bench;
+    size_t count = bench->messages / bench->producers;
+    uint8_t message[MESSAGE_SIZE_MAX];
+
+    pin_thread(p->index + 1);
+    memset(message, 0x55, sizeof(message));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (bench->ack != NULL)
+        {
+            SEM_Wait(bench->ack, -1, true);
+        }
+
+        uint64_t stamp = bench_now_ns();
+
+        switch (bench->kind)
+        {
+            case BENCH_RING_LOCKED:
+            case BENCH_RING_SPSC:
+                memcpy(message, &stamp, sizeof(stamp));
+                RING_Write_Blocking(bench->ring, message, bench->size);
+                break;
+
+            case BENCH_FIFO:
+            {
+                uint8_t *element = POOL_Alloc(bench->pool, bench->size);
+                memcpy(element, message, bench->size);
+                memcpy(element, &stamp, sizeof(stamp));
+                FIFO_Push_Blocking(bench->fifo, element);
+                break;
+            }
+
+            case BENCH_SEM:
+            case BENCH_POLL_SET:
+            case BENCH_POLL_ARRAY:
+                /* Stamp goes through a side queue, the semaphore only
+                 * carries the wakeup */
+                MPMC_Enqueue(&bench->stamps, (void *) (uintptr_t) stamp);
+                SEM_Give(bench->sem);
+                break;
+        }
+    }
+
+    return NULL;
+}
+
+/* Wait like the tio main loop does, through a poll set on the waitable */
+static void ring_read_message(bench_t *bench, POLL_Handle_t poll_set, uint8_t *message)
+{
+    size_t done = 0;
+    POLL_Event_t event;
+
+    while (done < bench->size)
+    {
+        uint32_t count = RING_Read(bench->ring, &message[done], bench->size - done);
+        if (count == 0)
+        {
+            POLL_Wait(poll_set, &event, 1, -1);
+        }
+        done += count;
+    }
+}
+
+static void consume(bench_t *bench)
+{
+    POLL_Handle_t poll_set = NULL;
+    uint8_t message[MESSAGE_SIZE_MAX];
+    size_t total = (bench->messages / bench->producers) * bench->producers;
+
+    if (bench->ring != NULL)
+    {
+        poll_set = POLL_Init(1);
+        POLL_Add(poll_set, RING_GetWaitable(bench->ring, RING_Available), POLL_IN, 0);
+    }
+    else if (bench->kind == BENCH_POLL_SET)
+    {
+        poll_set = POLL_Init(1);
+        POLL_Add(poll_set, SEM_GetWaitable(bench->sem), POLL_IN, 0);
+    }
+
+    for (size_t i = 0; i < total; i++)
+    {
+        uint64_t stamp = 0;
+
+        switch (bench->kind)
+        {
+            case BENCH_RING_LOCKED:
+            case BENCH_RING_SPSC:
+                ring_read_message(bench, poll_set, message);
+                memcpy(&stamp, message, sizeof(stamp));
+                break;
+
+            case BENCH_FIFO:
+            {
+                uint8_t *element = FIFO_Pop_Blocking(bench->fifo);
+                memcpy(&stamp, element, sizeof(stamp));
+                POOL_Free(bench->pool, element);
+                break;
+            }
+
+            case BENCH_SEM:
+            case BENCH_POLL_SET:
+            case BENCH_POLL_ARRAY:
+            {
+                void *data;
+                if (bench->kind == BENCH_SEM)
+                {
+                    SEM_Wait(bench->sem, -1, true);
+                }
+                while ((bench->kind != BENCH_SEM) && (SEM_Take(bench->sem) != 0))
+                {
+                    if (bench->kind == BENCH_POLL_SET)
+                    {
+                        POLL_Event_t event;
+                        POLL_Wait(poll_set, &event, 1, -1);
+                    }
+                    else
+                    {
+                        pollfd_t fds[1] = { { .fd = SEM_GetWaitable(bench->sem), .events = POLL_IN } };
+                        poll(fds, 1, -1);
+                    }
+                }
+                while (!MPMC_Dequeue(&bench->stamps, &data))
+                {
+                    MPMC_Yield();
+                }
+                stamp = (uintptr_t) data;
+                break;
+            }
+        }
+
+        if (bench->ack != NULL)
+        {
+            bench->latency[i] = bench_now_ns() - stamp;
+            SEM_Give(bench->ack);
+        }
+    }
+
+    POLL_Deinit(poll_set);
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+static const char *kind_name(bench_kind_t kind)
+{
+    switch (kind)
+    {
+        case BENCH_RING_LOCKED: return "ring-locked";
+        case BENCH_RING_SPSC:   return "ring-spsc";
+        case BENCH_FIFO:        return "fifo";
+        case BENCH_SEM:         return "sem";
+        case BENCH_POLL_SET:    return "poll-set";
+        case BENCH_POLL_ARRAY:  return "poll-array";
+    }
+    return "?";
+}
+
+/* One pass over all messages, returns elapsed time in nanoseconds. Latency
+ * is only recorded when paced. */
+static uint64_t run_pass(bench_kind_t kind, int producers, size_t size, size_t messages, uint64_t *latency)
+{
+    bench_t bench = { .kind = kind, .producers = producers, .size = size, .messages = messages };
+    producer_t args[PRODUCERS_MAX];
+    pthread_t threads[PRODUCERS_MAX];
+    size_t total = (messages / producers) * producers;
+
+    switch (kind)
+    {
+        case BENCH_RING_LOCKED:
+            bench.ring = RING_Init(RING_SIZE);
+            break;
+        case BENCH_RING_SPSC:
+            bench.ring = RING_Init_SPSC(RING_SIZE);
+            break;
+        case BENCH_FIFO:
+            bench.fifo = FIFO_Init(FIFO_LENGTH);
+            bench.pool = POOL_Init(size, FIFO_LENGTH);
+            break;
+        case BENCH_SEM:
+        case BENCH_POLL_SET:
+        case BENCH_POLL_ARRAY:
+            bench.sem = SEM_Init(0, false);
+            MPMC_Init(&bench.stamps, total);
+            break;
+    }
+
+    if (latency != NULL)
+    {
+        /* Single token shared by all producers */
+        bench.ack = SEM_Init(1, false);
+        bench.latency = latency;
+    }
+
+    pin_thread(0);
+
+    uint64_t start = bench_now_ns();
+
+    for (int i = 0; i < producers; i++)
+    {
+        args[i] = (producer_t) { .bench = &bench, .index = i };
+        pthread_create(&threads[i], NULL, producer, &args[i]);
+    }
+
+    consume(&bench);
+
+    uint64_t elapsed = bench_now_ns() - start;
+
+    for (int i = 0; i < producers; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    if (bench.ring != NULL)
+    {
+        RING_Deinit(bench.ring);
+    }
+    if (bench.pool != NULL)
+    {
+        POOL_Deinit(bench.pool);
+    }
+    if (bench.sem != NULL)
+    {
+        SEM_Deinit(bench.sem);
+        MPMC_Deinit(&bench.stamps);
+    }
+    if (bench.ack != NULL)
+    {
+        SEM_Deinit(bench.ack);
+    }
+
+    return elapsed;
+}
+
+static void run(bench_kind_t kind, int producers, size_t size, size_t messages)
+{
+    size_t total = (messages / producers) * producers;
+    uint64_t *latency = malloc(total * sizeof(uint64_t));
+    char label[64];
+
+    uint64_t elapsed = run_pass(kind, producers, size, messages, NULL);
+    run_pass(kind, producers, size, messages, latency);
+
+    qsort(latency, total, sizeof(uint64_t), compare_u64);
+
+    snprintf(label, sizeof(label), "%s/%d:1/%zuB%s", kind_name(kind), producers, size, pin ? "/pinned" : "");
+    bench_report("compat", label, "throughput", total * 1e9 / elapsed, "ops/s");
+    bench_report("compat", label, "p50", latency[total / 2], "ns");
+    bench_report("compat", label, "p99", latency[total * 99 / 100], "ns");
+
+    free(latency);
+}
+
+static void cpus_init(void)
+{
+#ifdef __linux__
+    cpu_set_t set;
+
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+    {
+        return;
+    }
+
+    for (int i = 0; i < CPU_SETSIZE; i++)
+    {
+        if (CPU_ISSET(i, &set))
+        {
+            cpus[cpu_count++] = i;
+        }
+    }
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    static const size_t sizes[] = { 16, 256, 4096 };
+    static const int layouts[] = { 1, 4, 16 };
+    bool ring = false, fifo = false, sem = false, wake = false;
+    size_t messages = MESSAGES_DEFAULT;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "pn:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'p':
+                pin = true;
+                break;
+            case 'n':
+                messages = strtoul(optarg, NULL, 10);
+                if (messages < PRODUCERS_MAX)
+                {
+                    fprintf(stderr, "Need at least %d messages, one per producer\n", PRODUCERS_MAX);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-p] [-n messages] [ring|fifo|sem|poll]...\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    for (int i = optind; i < argc; i++)
+    {
+        ring |= !strcmp(argv[i], "ring");
+        fifo |= !strcmp(argv[i], "fifo");
+        sem  |= !strcmp(argv[i], "sem");
+        wake |= !strcmp(argv[i], "poll");
+    }
+    if (optind == argc)
+    {
+        ring = fifo = sem = wake = true;
+    }
+
+    cpus_init();
+
+    fprintf(stderr, "%zu messages per case\n", messages);
+    bench_header();
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        /* Ring is a byte stream, several writers would interleave
+         * messages, so it is only measured 1:1 */
+        if (ring)
+        {
+            run(BENCH_RING_LOCKED, 1, sizes[s], messages);
+            run(BENCH_RING_SPSC, 1, sizes[s], messages);
+        }
+
+        for (size_t l = 0; fifo && (l < sizeof(layouts) / sizeof(layouts[0])); l++)
+        {
+            run(BENCH_FIFO, layouts[l], sizes[s], messages);
+        }
+    }
+
+    for (size_t l = 0; sem && (l < sizeof(layouts) / sizeof(layouts[0])); l++)
+    {
+        run(BENCH_SEM, layouts[l], 0, messages);
+    }
+
+    /* Single waiter, like the main loop */
+    if (wake)
+    {
+        run(BENCH_POLL_SET, 1, 0, messages);
+        run(BENCH_POLL_ARRAY, 1, 0, messages);
+    }
+
+    return EXIT_SUCCESS;
+}
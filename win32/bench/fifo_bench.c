@@ -0,0 +1,234 @@
+/*
+ * tio - a serial device I/O tool
+ *
+ * Copyright (c) 2014-2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Contention benchmark of the posix_compat FIFO (bounded MPMC queue with a
+ * block pool for payloads) against the mutex protected linked list with
+ * per message malloc() it replaces. N producers feed a single consumer,
+ * like ssServer's send queue.
+ *
+ * Usage: fifo_bench [messages per producer] [queue length]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cthread.h"
+#include "semaphore.h"
+#include "fifo.h"
+#include "pool.h"
+#include "bench.h"
+
+#define MESSAGES_DEFAULT     50000
+#define QUEUE_LENGTH_DEFAULT 1024
+#define MESSAGE_SIZE         64
+
+/* Reference: the FIFO as it was, a node is malloc'ed on every push */
+typedef struct list_node
+{
+    struct list_node *next;
+    void *data;
+} list_node_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    SEM_Handle_t sem_free;
+    SEM_Handle_t sem_avail;
+    list_node_t *head;
+    list_node_t *tail;
+} list_fifo_t;
+
+typedef struct
+{
+    bool reference;
+    list_fifo_t list;
+    FIFO_Handle_t fifo;
+    POOL_Handle_t pool;
+    size_t messages;
+} bench_t;
+
+static void list_push(list_fifo_t *list, void *data)
+{
+    list_node_t *node = malloc(sizeof(*node));
+
+    node->data = data;
+    node->next = NULL;
+
+    SEM_Wait(list->sem_free, -1, true);
+    pthread_mutex_lock(&list->lock);
+    if (list->head == NULL)
+    {
+        list->head = node;
+    }
+    else
+    {
+        list->tail->next = node;
+    }
+    list->tail = node;
+    pthread_mutex_unlock(&list->lock);
+    SEM_Give(list->sem_avail);
+}
+
+static void *list_pop(list_fifo_t *list)
+{
+    list_node_t *node;
+    void *data;
+
+    SEM_Wait(list->sem_avail, -1, true);
+    pthread_mutex_lock(&list->lock);
+    node = list->head;
+    list->head = node->next;
+    pthread_mutex_unlock(&list->lock);
+    SEM_Give(list->sem_free);
+
+    data = node->data;
+    free(node);
+
+    return data;
+}
+
+static void *producer(void *arg)
+{
+    bench_t *bench = arg;
+    char message[MESSAGE_SIZE];
+
+    memset(message, 'x', sizeof(message));
+
+    for (size_t i = 0; i < bench->messages; i++)
+    {
+        if (bench->reference)
+        {
+            void *element = malloc(sizeof(message));
+            memcpy(element, message, sizeof(message));
+            list_push(&bench->list, element);
+        }
+        else
+        {
+            void *element = POOL_Alloc(bench->pool, sizeof(message));
+            memcpy(element, message, sizeof(message));
+            FIFO_Push_Blocking(bench->fifo, element);
+        }
+    }
+
+    return NULL;
+}
+
+static void run(bool reference, int producers, size_t messages, unsigned int length)
+{
+    bench_t bench = { .reference = reference, .messages = messages };
+    pthread_t threads[16];
+    size_t total = messages * producers;
+    volatile char sink = 0;
+    char label[32];
+    uint64_t start;
+
+    if (reference)
+    {
+        pthread_mutex_init(&bench.list.lock, NULL);
+        bench.list.sem_free = SEM_Init(length, false);
+        bench.list.sem_avail = SEM_Init(0, false);
+    }
+    else
+    {
+        bench.fifo = FIFO_Init(length);
+        bench.pool = POOL_Init(MESSAGE_SIZE, length);
+    }
+
+    start = bench_now_ns();
+    for (int i = 0; i < producers; i++)
+    {
+        pthread_create(&threads[i], NULL, producer, &bench);
+    }
+
+    /* Single consumer, like the ssServer send worker */
+    for (size_t i = 0; i < total; i++)
+    {
+        char *element;
+
+        if (reference)
+        {
+            element = list_pop(&bench.list);
+            sink ^= element[0];
+            free(element);
+        }
+        else
+        {
+            element = FIFO_Pop_Blocking(bench.fifo);
+            sink ^= element[0];
+            POOL_Free(bench.pool, element);
+        }
+    }
+
+    for (int i = 0; i < producers; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    uint64_t elapsed = bench_now_ns() - start;
+
+    snprintf(label, sizeof(label), "%d:1/%s", producers, reference ? "list" : "mpmc+pool");
+    bench_report("fifo", label, "throughput", total * 1e9 / elapsed, "msg/s");
+    bench_report("fifo", label, "cost", (double) elapsed / total, "ns/msg");
+
+    if (reference)
+    {
+        SEM_Deinit(bench.list.sem_free);
+        SEM_Deinit(bench.list.sem_avail);
+        pthread_mutex_destroy(&bench.list.lock);
+    }
+    else
+    {
+        POOL_Deinit(bench.pool);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static const int producers[] = { 1, 4, 16 };
+    size_t messages = MESSAGES_DEFAULT;
+    unsigned int length = QUEUE_LENGTH_DEFAULT;
+
+    if (argc > 1)
+    {
+        messages = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2)
+    {
+        length = strtoul(argv[2], NULL, 10);
+    }
+    if (length == 0)
+    {
+        fprintf(stderr, "queue length must not be 0\n");
+        return 1;
+    }
+
+    fprintf(stderr, "%zu messages of %d bytes per producer, queue length %u\n", messages, MESSAGE_SIZE, length);
+    bench_header();
+
+    for (size_t i = 0; i < sizeof(producers) / sizeof(producers[0]); i++)
+    {
+        run(true, producers[i], messages, length);
+        run(false, producers[i], messages, length);
+    }
+
+    return 0;
+}
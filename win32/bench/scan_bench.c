@@ -0,0 +1,276 @@
+/*
+ * tio - a serial device I/O tool
+ *
+ * Copyright (c) 2014-2022  Martin Lund
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Microbenchmark of the RX byte classification kernels (scan.c) against
+ * the per-byte loop they replace. Before timing anything, hex stream
+ * decoding is checked to give the same bytes wherever the input is split.
+ *
+ * Usage: scan_bench [buffer size] [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scan.h"
+#include "bench.h"
+
+#define BUFFER_SIZE_DEFAULT 4096
+#define ITERATIONS_DEFAULT  20000
+
+static volatile size_t sink;
+
+/* Printable text with a newline every 40 to 120 characters */
+static void fill_text(char *buffer, size_t size)
+{
+    size_t i, next = 40 + rand() % 80;
+
+    for (i = 0; i < size; i++)
+    {
+        if (i == next)
+        {
+            buffer[i] = '\n';
+            next = i + 40 + rand() % 80;
+        }
+        else
+        {
+            buffer[i] = 0x20 + rand() % 0x5f;
+        }
+    }
+}
+
+/* Reference: the per-byte branch the RX loop used to take */
+static size_t loop_chars(const char *buffer, size_t count, bool ff)
+{
+    size_t i, found = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        char c = buffer[i];
+        if ((c == '\n') || ((c == '\f') && ff))
+        {
+            found++;
+        }
+    }
+
+    return found;
+}
+
+/* Reference: control character check done by log_strip() on each byte */
+static size_t loop_ctrl(const char *buffer, size_t count)
+{
+    size_t i, found = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        char c = buffer[i];
+        if ((c >= 0x00) && (c <= 0x1f))
+        {
+            found++;
+        }
+    }
+
+    return found;
+}
+
+static size_t kernel_chars(const scan_set_t *set, const char *buffer, size_t count)
+{
+    size_t i = 0, found = 0;
+
+    while (i < count)
+    {
+        i += scan_chars(set, &buffer[i], count - i);
+        if (i < count)
+        {
+            found++;
+            i++;
+        }
+    }
+
+    return found;
+}
+
+static size_t kernel_ctrl(const char *buffer, size_t count)
+{
+    size_t i = 0, found = 0;
+
+    while (i < count)
+    {
+        i += scan_ctrl(&buffer[i], count - i);
+        if (i < count)
+        {
+            found++;
+            i++;
+        }
+    }
+
+    return found;
+}
+
+/* Printable text without line breaks, e.g. a long binary-ish stream */
+static void fill_stream(char *buffer, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        buffer[i] = 0x20 + rand() % 0x5f;
+    }
+}
+
+/* Decode sample in two pieces at every split point and compare with the
+ * result of decoding it at once */
+static bool check_hex_split(void)
+{
+    static const char sample[] = "de ad:be,ef 0x12 3 45\n6789abcdef a bc d 0X7f";
+    unsigned char whole[sizeof(sample)], split[sizeof(sample)];
+    size_t count = sizeof(sample) - 1;
+    size_t expected, n, invalid;
+    int pending = -1;
+
+    expected = scan_hex_decode_stream(&pending, whole, sample, count, &invalid);
+
+    for (size_t at = 0; at <= count; at++)
+    {
+        pending = -1;
+        n = scan_hex_decode_stream(&pending, split, sample, at, &invalid);
+        n += scan_hex_decode_stream(&pending, &split[n], &sample[at], count - at, &invalid);
+
+        if ((n != expected) || memcmp(whole, split, n))
+        {
+            fprintf(stderr, "hex decode differs when split at %zu\n", at);
+            return false;
+        }
+    }
+
+    /* Pending high nibble followed by a separator is dropped */
+    pending = 0xa;
+    n = scan_hex_decode_stream(&pending, split, " bc d", 5, &invalid);
+    if ((n != 1) || (split[0] != 0xbc) || (pending != 0xd) || (invalid != 1))
+    {
+        fprintf(stderr, "hex decode kept a stale nibble\n");
+        return false;
+    }
+
+    return true;
+}
+
+static void report(const char *data, const char *name, const char *impl, uint64_t start, size_t bytes)
+{
+    char label[64];
+
+    snprintf(label, sizeof(label), "%s/%s/%s", data, name, impl);
+    bench_report("scan", label, "throughput", bytes * 1e3 / (bench_now_ns() - start), "MB/s");
+}
+
+static void run(const char *data, const char *buffer, size_t size, size_t iterations)
+{
+    static const char special_chars[] = { '\n', '\f' };
+    static const enum scan_impl_t impls[] =
+    {
+        SCAN_IMPL_SCALAR, SCAN_IMPL_SSE2, SCAN_IMPL_AVX2, SCAN_IMPL_NEON
+    };
+    scan_set_t set;
+    size_t i, n, found;
+    uint64_t start;
+
+    scan_set_init(&set, special_chars, 2);
+
+    start = bench_now_ns();
+    for (n = 0, found = 0; n < iterations; n++)
+    {
+        found += loop_chars(buffer, size, true);
+    }
+    report(data, "rx", "loop", start, size * iterations);
+    sink = found;
+
+    for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++)
+    {
+        if (!scan_impl_select(impls[i]))
+        {
+            continue;
+        }
+
+        start = bench_now_ns();
+        for (n = 0, found = 0; n < iterations; n++)
+        {
+            found += kernel_chars(&set, buffer, size);
+        }
+        report(data, "rx", scan_impl_name(), start, size * iterations);
+        sink = found;
+    }
+
+    start = bench_now_ns();
+    for (n = 0, found = 0; n < iterations; n++)
+    {
+        found += loop_ctrl(buffer, size);
+    }
+    report(data, "ctrl", "loop", start, size * iterations);
+    sink = found;
+
+    for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++)
+    {
+        if (!scan_impl_select(impls[i]))
+        {
+            continue;
+        }
+
+        start = bench_now_ns();
+        for (n = 0, found = 0; n < iterations; n++)
+        {
+            found += kernel_ctrl(buffer, size);
+        }
+        report(data, "ctrl", scan_impl_name(), start, size * iterations);
+        sink = found;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t size = (argc > 1) ? strtoul(argv[1], NULL, 0) : BUFFER_SIZE_DEFAULT;
+    size_t iterations = (argc > 2) ? strtoul(argv[2], NULL, 0) : ITERATIONS_DEFAULT;
+    char *buffer;
+
+    if (!check_hex_split())
+    {
+        return EXIT_FAILURE;
+    }
+
+    buffer = malloc(size);
+    if (buffer == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    srand(1);
+
+    fprintf(stderr, "buffer %zu bytes, %zu iterations\n", size, iterations);
+    bench_header();
+
+    fill_text(buffer, size);
+    run("text", buffer, size, iterations);
+
+    fill_stream(buffer, size);
+    run("stream", buffer, size, iterations);
+
+    free(buffer);
+
+    return EXIT_SUCCESS;
+}
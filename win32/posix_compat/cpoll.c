@@ -6,18 +6,41 @@
 * @date    06/10/2023
 * @brief   poll wrapper
 */
-#ifdef _WIN32
 /* Includes ------------------------------------------------------------------*/
 #include <stdlib.h>
+#ifdef __linux__
+# include <errno.h>
+# include <unistd.h>
+# include <sys/epoll.h>
+#endif
 #include "cpoll.h"
 /* Private defines --------------------------------------------------------- */
 /* Private types ------------------------------------------------------------*/
+/* Poll set handle */
+struct _POLL_t
+{
+#ifdef __linux__
+    int Epfd;
+    struct epoll_event *Ready;
+#else
+    pollfd_t *Active;
+    int *ActiveIds;
+#endif
+    WAIT_HANDLE *Fds;
+    short *Events;
+    int *Ids;
+    unsigned int Length;
+    unsigned int Count;
+};
 /* Private constants --------------------------------------------------------*/
 #define WAIT_HANDLE_MAX 64
-/* Private macro ------------------------------------------------------------*/
+/* Private macro -------------------------------------------------------------*/
 /* Private functions ------------------------------------------------------- */
+#ifdef _WIN32
 int poll(pollfd_t *fds, nfds_t nfds, int timeout)
 {
+    HANDLE fd_set[WAIT_HANDLE_MAX];
+
     if(nfds > WAIT_HANDLE_MAX)
         return -1;
 
@@ -27,7 +50,7 @@ int poll(pollfd_t *fds, nfds_t nfds, int timeout)
         if(fds[i].fd != NULL && fds[i].fd != INVALID_HANDLE_VALUE)
         {
             fds[i].revents = 0;
-            valid_fds++;
+            fd_set[valid_fds++] = fds[i].fd;
         }
         else
         {
@@ -38,21 +61,10 @@ int poll(pollfd_t *fds, nfds_t nfds, int timeout)
     if(!valid_fds)
         return -1;
 
-    HANDLE* fd_set = malloc(sizeof(HANDLE) * valid_fds);
-    if(!fd_set) return -1;
-
-    for(int i = 0, idx = 0; i < nfds; i++)
-    {
-        if(fds[i].revents == 0)
-            fd_set[idx++] = fds[i].fd;
-    }
-
     if(timeout < 0) timeout = INFINITE;
 
     DWORD ret = WaitForMultipleObjects(valid_fds, fd_set, FALSE, timeout);
 
-    free(fd_set);
-
     if(ret >= WAIT_OBJECT_0 && ret <= WAIT_OBJECT_0 + WAIT_HANDLE_MAX - 1)
     {
         int cnt = 0;
@@ -96,4 +108,294 @@ int poll(pollfd_t *fds, nfds_t nfds, int timeout)
         return -1;
     }
 }
-#endif
\ No newline at end of file
+#endif
+
+#ifdef __linux__
+static uint32_t to_epoll(short Events)
+{
+    uint32_t ev = 0;
+
+    if(Events & POLL_IN)  ev |= EPOLLIN;
+    if(Events & POLL_PRI) ev |= EPOLLPRI;
+    if(Events & POLL_OUT) ev |= EPOLLOUT;
+
+    return ev;
+}
+
+static short from_epoll(uint32_t ev)
+{
+    short Events = 0;
+
+    if(ev & EPOLLIN)  Events |= POLL_IN;
+    if(ev & EPOLLPRI) Events |= POLL_PRI;
+    if(ev & EPOLLOUT) Events |= POLL_OUT;
+    if(ev & EPOLLERR) Events |= POLL_ERR;
+    if(ev & EPOLLHUP) Events |= POLL_HUP;
+
+    return Events;
+}
+
+/* Muted handles are left out of the epoll set, as epoll would still report
+ * errors and hang ups with an empty event mask. Events carry the caller's
+ * Id so they don't depend on the slot of the handle in the set. */
+static int epoll_set(POLL_Handle_t hPOLL, int Op, WAIT_HANDLE Fd, short Events, int Id)
+{
+    struct epoll_event ev = { .events = to_epoll(Events), .data.u32 = (uint32_t)Id };
+
+    return epoll_ctl(hPOLL->Epfd, Op, Fd, &ev);
+}
+#endif
+
+static int find(POLL_Handle_t hPOLL, WAIT_HANDLE Fd)
+{
+    for(unsigned int i = 0; i < hPOLL->Count; i++)
+    {
+        if(hPOLL->Fds[i] == Fd)
+            return i;
+    }
+
+    return -1;
+}
+
+/**
+ * @fn POLL_Handle_t POLL_Init(unsigned int Length)
+ *
+ * @brief Initialize a persistent poll set.
+ *
+ * @param Length Maximum number of handles in the set.
+ *
+ * @retval Poll set handle, or NULL on fail.
+ */
+POLL_Handle_t POLL_Init(unsigned int Length)
+{
+    if(Length == 0 || Length > WAIT_HANDLE_MAX)
+        return NULL;
+
+    POLL_Handle_t POLL = calloc(1, sizeof(struct _POLL_t));
+    if(POLL == NULL)
+        return NULL;
+
+    POLL->Fds    = calloc(Length, sizeof(WAIT_HANDLE));
+    POLL->Events = calloc(Length, sizeof(short));
+    POLL->Ids    = calloc(Length, sizeof(int));
+#ifdef __linux__
+    POLL->Ready  = calloc(Length, sizeof(struct epoll_event));
+    POLL->Epfd   = epoll_create1(EPOLL_CLOEXEC);
+    if(!POLL->Fds || !POLL->Events || !POLL->Ids || !POLL->Ready || POLL->Epfd < 0)
+#else
+    POLL->Active    = calloc(Length, sizeof(pollfd_t));
+    POLL->ActiveIds = calloc(Length, sizeof(int));
+    if(!POLL->Fds || !POLL->Events || !POLL->Ids || !POLL->Active || !POLL->ActiveIds)
+#endif
+    {
+        POLL_Deinit(POLL);
+        return NULL;
+    }
+
+    POLL->Length = Length;
+    POLL->Count  = 0;
+
+    return POLL;
+}
+
+/**
+ * @fn int POLL_Deinit(POLL_Handle_t hPOLL)
+ *
+ * @brief De-initialize poll set.
+ *
+ * @param hPOLL Poll set handle.
+ *
+ * @retval 0 on success, -1 on fail.
+ */
+int POLL_Deinit(POLL_Handle_t hPOLL)
+{
+    if(!hPOLL)
+        return -1;
+
+#ifdef __linux__
+    if(hPOLL->Epfd >= 0)
+        close(hPOLL->Epfd);
+    free(hPOLL->Ready);
+#else
+    free(hPOLL->Active);
+    free(hPOLL->ActiveIds);
+#endif
+    free(hPOLL->Fds);
+    free(hPOLL->Events);
+    free(hPOLL->Ids);
+    free(hPOLL);
+
+    return 0;
+}
+
+/**
+ * @fn int POLL_Add(POLL_Handle_t hPOLL, WAIT_HANDLE Fd, short Events, int Id)
+ *
+ * @brief Add a waitable handle to the poll set.
+ *
+ * @param hPOLL Poll set handle.
+ * @param Fd Waitable handle.
+ * @param Events Events to wait (POLL_IN, POLL_OUT...).
+ * @param Id Identifier reported back by POLL_Wait().
+ *
+ * @retval 0 on success, -1 on fail.
+ */
+int POLL_Add(POLL_Handle_t hPOLL, WAIT_HANDLE Fd, short Events, int Id)
+{
+    if(!hPOLL || hPOLL->Count >= hPOLL->Length || find(hPOLL, Fd) >= 0)
+        return -1;
+
+#ifdef __linux__
+    if(Events && epoll_set(hPOLL, EPOLL_CTL_ADD, Fd, Events, Id) < 0)
+        return -1;
+#endif
+
+    hPOLL->Fds[hPOLL->Count]    = Fd;
+    hPOLL->Events[hPOLL->Count] = Events;
+    hPOLL->Ids[hPOLL->Count]    = Id;
+    hPOLL->Count++;
+
+    return 0;
+}
+
+/**
+ * @fn int POLL_Modify(POLL_Handle_t hPOLL, WAIT_HANDLE Fd, short Events)
+ *
+ * @brief Change the events waited on a handle of the poll set.
+ *
+ * @param hPOLL Poll set handle.
+ * @param Fd Waitable handle.
+ * @param Events Events to wait, 0 to mute the handle. A muted handle
+ *               reports nothing, not even POLL_ERR or POLL_HUP.
+ *
+ * @retval 0 on success, -1 on fail.
+ */
+int POLL_Modify(POLL_Handle_t hPOLL, WAIT_HANDLE Fd, short Events)
+{
+    if(!hPOLL)
+        return -1;
+
+    int idx = find(hPOLL, Fd);
+    if(idx < 0)
+        return -1;
+
+    if(hPOLL->Events[idx] == Events)
+        return 0;
+
+#ifdef __linux__
+    int ret;
+
+    if(Events == 0)
+        ret = epoll_ctl(hPOLL->Epfd, EPOLL_CTL_DEL, Fd, NULL);
+    else if(hPOLL->Events[idx] == 0)
+        ret = epoll_set(hPOLL, EPOLL_CTL_ADD, Fd, Events, hPOLL->Ids[idx]);
+    else
+        ret = epoll_set(hPOLL, EPOLL_CTL_MOD, Fd, Events, hPOLL->Ids[idx]);
+
+    if(ret < 0)
+        return -1;
+#endif
+
+    hPOLL->Events[idx] = Events;
+
+    return 0;
+}
+
+/**
+ * @fn int POLL_Remove(POLL_Handle_t hPOLL, WAIT_HANDLE Fd)
+ *
+ * @brief Remove a waitable handle from the poll set.
+ *
+ * @param hPOLL Poll set handle.
+ * @param Fd Waitable handle.
+ *
+ * @retval 0 on success, -1 on fail.
+ */
+int POLL_Remove(POLL_Handle_t hPOLL, WAIT_HANDLE Fd)
+{
+    if(!hPOLL)
+        return -1;
+
+    int idx = find(hPOLL, Fd);
+    if(idx < 0)
+        return -1;
+
+    unsigned int last = hPOLL->Count - 1;
+
+#ifdef __linux__
+    /* Handle may already be closed, in which case the kernel dropped it */
+    if(hPOLL->Events[idx] && epoll_ctl(hPOLL->Epfd, EPOLL_CTL_DEL, Fd, NULL) < 0 && errno != EBADF)
+        return -1;
+#endif
+
+    hPOLL->Fds[idx]    = hPOLL->Fds[last];
+    hPOLL->Events[idx] = hPOLL->Events[last];
+    hPOLL->Ids[idx]    = hPOLL->Ids[last];
+    hPOLL->Count--;
+
+    return 0;
+}
+
+/**
+ * @fn int POLL_Wait(POLL_Handle_t hPOLL, POLL_Event_t *Events, int Length, int Timeout)
+ *
+ * @brief Wait for events on the poll set.
+ *
+ * @param hPOLL Poll set handle.
+ * @param Events Array receiving ready handles.
+ * @param Length Array length.
+ * @param Timeout Timeout in milliseconds, negative for infinite.
+ *
+ * @retval Number of events on success, 0 on timeout, -1 on fail.
+ */
+int POLL_Wait(POLL_Handle_t hPOLL, POLL_Event_t *Events, int Length, int Timeout)
+{
+    if(!hPOLL || !Events || Length <= 0)
+        return -1;
+
+#ifdef __linux__
+    if(Length > (int)hPOLL->Length)
+        Length = hPOLL->Length;
+
+    int ret = epoll_wait(hPOLL->Epfd, hPOLL->Ready, Length, Timeout);
+    for(int i = 0; i < ret; i++)
+    {
+        Events[i].Id      = (int)hPOLL->Ready[i].data.u32;
+        Events[i].revents = from_epoll(hPOLL->Ready[i].events);
+    }
+
+    return ret;
+#else
+    nfds_t nfds = 0;
+
+    /* Only pass handles which are currently waited */
+    for(unsigned int i = 0; i < hPOLL->Count; i++)
+    {
+        if(hPOLL->Events[i])
+        {
+            hPOLL->Active[nfds].fd      = hPOLL->Fds[i];
+            hPOLL->Active[nfds].events  = hPOLL->Events[i];
+            hPOLL->Active[nfds].revents = 0;
+            hPOLL->ActiveIds[nfds]      = hPOLL->Ids[i];
+            nfds++;
+        }
+    }
+
+    int ret = poll(hPOLL->Active, nfds, Timeout);
+    if(ret <= 0)
+        return ret;
+
+    int cnt = 0;
+    for(nfds_t i = 0; i < nfds && cnt < Length; i++)
+    {
+        if(hPOLL->Active[i].revents)
+        {
+            Events[cnt].Id      = hPOLL->ActiveIds[i];
+            Events[cnt].revents = hPOLL->Active[i].revents;
+            cnt++;
+        }
+    }
+
+    return cnt;
+#endif
+}
@@ -44,11 +44,104 @@ typedef struct _pollfd_t
 
 typedef unsigned int nfds_t;
 #endif
+
+/* Poll set handle */
+typedef struct _POLL_t *POLL_Handle_t;
+
+/* Poll set event */
+typedef struct
+{
+    int Id;
+    short revents;
+}POLL_Event_t;
 /* Exported constants --------------------------------------------------------*/
 /* Exported macro ------------------------------------------------------------*/
+#ifndef WAIT_HANDLE
+#ifdef _WIN32
+# define WAIT_HANDLE void*
+#else
+# define WAIT_HANDLE int
+#endif
+#endif
 /* Exported functions ------------------------------------------------------- */
 #ifdef _WIN32
 int poll(pollfd_t *fds, nfds_t nfds, int timeout);
 #endif
 
+/**
+ * @fn POLL_Handle_t POLL_Init(unsigned int Length)
+ *
+ * @brief Initialize a persistent poll set.
+ *
+ * @param Length Maximum number of handles in the set.
+ *
+ * @retval Poll set handle, or NULL on fail.
+ */
+POLL_Handle_t POLL_Init(unsigned int Length);
+
+/**
+ * @fn int POLL_Deinit(POLL_Handle_t hPOLL)
+ *
+ * @brief De-initialize poll set.
+ *
+ * @param hPOLL Poll set handle.
+ *
+ * @retval 0 on success, -1 on fail.
+ */
+int POLL_Deinit(POLL_Handle_t hPOLL);
+
+/**
+ * @fn int POLL_Add(POLL_Handle_t hPOLL, WAIT_HANDLE Fd, short Events, int Id)
+ *
+ * @brief Add a waitable handle to the poll set.
+ *
+ * @param hPOLL Poll set handle.
+ * @param Fd Waitable handle.
+ * @param Events Events to wait (POLL_IN, POLL_OUT...).
+ * @param Id Identifier reported back by POLL_Wait().
+ *
+ * @retval 0 on success, -1 on fail.
+ */
+int POLL_Add(POLL_Handle_t hPOLL, WAIT_HANDLE Fd, short Events, int Id);
+
+/**
+ * @fn int POLL_Modify(POLL_Handle_t hPOLL, WAIT_HANDLE Fd, short Events)
+ *
+ * @brief Change the events waited on a handle of the poll set.
+ *
+ * @param hPOLL Poll set handle.
+ * @param Fd Waitable handle.
+ * @param Events Events to wait, 0 to mute the handle. A muted handle
+ *               reports nothing, not even POLL_ERR or POLL_HUP.
+ *
+ * @retval 0 on success, -1 on fail.
+ */
+int POLL_Modify(POLL_Handle_t hPOLL, WAIT_HANDLE Fd, short Events);
+
+/**
+ * @fn int POLL_Remove(POLL_Handle_t hPOLL, WAIT_HANDLE Fd)
+ *
+ * @brief Remove a waitable handle from the poll set.
+ *
+ * @param hPOLL Poll set handle.
+ * @param Fd Waitable handle.
+ *
+ * @retval 0 on success, -1 on fail.
+ */
+int POLL_Remove(POLL_Handle_t hPOLL, WAIT_HANDLE Fd);
+
+/**
+ * @fn int POLL_Wait(POLL_Handle_t hPOLL, POLL_Event_t *Events, int Length, int Timeout)
+ *
+ * @brief Wait for events on the poll set.
+ *
+ * @param hPOLL Poll set handle.
+ * @param Events Array receiving ready handles.
+ * @param Length Array length.
+ * @param Timeout Timeout in milliseconds, negative for infinite.
+ *
+ * @retval Number of events on success, 0 on timeout, -1 on fail.
+ */
+int POLL_Wait(POLL_Handle_t hPOLL, POLL_Event_t *Events, int Length, int Timeout);
+
 #endif
@@ -8,26 +8,16 @@
 */
 /* Includes ------------------------------------------------------------------*/
 #include <stdlib.h>
-#include <limits.h>
 #include "fifo.h"
+#include "mpmc.h"
 #include "semaphore.h"
-#include "cthread.h"
 /* Private typedef -----------------------------------------------------------*/
-/* FIFO element node */
-typedef struct _FIFO_Node_t
-{
-    struct _FIFO_Node_t *Next;
-    void *       Data;
-}FIFO_Node_t;
 /* FIFO handle */
 struct _FIFO_t
 {
-    pthread_mutex_t Lock;
+    MPMC_Queue_t Queue;
     SEM_Handle_t SemFree;
     SEM_Handle_t SemAvail;
-    FIFO_Node_t *Head;
-    FIFO_Node_t *Tail;
-    unsigned int Length;
 };
 /* Private define ------------------------------------------------------------*/
 /* Private macro -------------------------------------------------------------*/
@@ -41,66 +31,54 @@ static void* Pop(FIFO_Handle_t hFIFO);
  *
  * @brief Initialize FIFO.
  *
- * @param Length Maximum FIFO length, 0 if unlimited.
+ * @param Length Maximum FIFO length, must not be 0.
  *
- * @retval FIFO handle.
+ * @retval FIFO handle, or NULL on fail.
  */
 FIFO_Handle_t FIFO_Init(unsigned int Length)
 {
-    FIFO_Handle_t FIFO = malloc(sizeof(struct _FIFO_t));
+    FIFO_Handle_t FIFO;
+
+    /* Queue is bounded, callers must size it */
     if(!Length)
+        return NULL;
+
+    FIFO = malloc(sizeof(struct _FIFO_t));
+    if(FIFO == NULL)
+        return NULL;
+
+    if(MPMC_Init(&FIFO->Queue, Length) != 0)
     {
-        Length = UINT_MAX;
+        free(FIFO);
+        return NULL;
     }
 
-    pthread_mutex_init(&FIFO->Lock, NULL);
     FIFO->SemFree = SEM_Init(Length, false);
     FIFO->SemAvail = SEM_Init(0, false);
 
-    FIFO->Length    = 0;
-    FIFO->Head      = NULL;
-    FIFO->Tail      = NULL;
-
     return FIFO;
 }
 
 /**
  * @fn void Push(FIFO_Handle_t hFIFO, void *Data)
  *
- * @brief Push element to FIFO.
+ * @brief Push element to FIFO, caller must own a free slot.
  *
  * @param hFIFO FIFO handle.
  * @param Data Pointer to Data.
  */
 static void Push(FIFO_Handle_t hFIFO, void *Data)
 {
-    FIFO_Node_t * node;
-
-    node = malloc(sizeof(*node));
-    node->Data = Data;
-    node->Next = NULL;
-
-    pthread_mutex_lock(&hFIFO->Lock);
-
-    if(hFIFO->Head == NULL)
-    {
-        hFIFO->Head = node;
-        hFIFO->Tail = node;
-    }
-    else
-    {
-        hFIFO->Tail->Next = node;
-        hFIFO->Tail       = node;
-    }
-    hFIFO->Length++;
-
-    pthread_mutex_unlock(&hFIFO->Lock);
+    /* Slot is reserved by SemFree, it can only look full while the
+     * consumer of the previous lap is still copying out */
+    while(!MPMC_Enqueue(&hFIFO->Queue, Data))
+        MPMC_Yield();
 }
 
 /**
  * @fn void* Pop(FIFO_Handle_t hFIFO)
  *
- * @brief Pop element from FIFO.
+ * @brief Pop element from FIFO, caller must own an available element.
  *
  * @param hFIFO FIFO handle.
  *
@@ -108,27 +86,12 @@ static void Push(FIFO_Handle_t hFIFO, void *Data)
  */
 static void* Pop(FIFO_Handle_t hFIFO)
 {
-    FIFO_Node_t *node;
     void *data;
 
-    pthread_mutex_lock(&hFIFO->Lock);
-
-    node = hFIFO->Head;
-    if(hFIFO->Head == hFIFO->Tail)
-    {
-        hFIFO->Head = NULL;
-        hFIFO->Tail = NULL;
-    }
-    else
-    {
-        hFIFO->Head = node->Next;
-    }
-    hFIFO->Length--;
-
-    pthread_mutex_unlock(&hFIFO->Lock);
-
-    data = node->Data;
-    free(node);
+    /* Element is reserved by SemAvail, it can only look missing while an
+     * earlier producer is still writing its cell */
+    while(!MPMC_Dequeue(&hFIFO->Queue, &data))
+        MPMC_Yield();
 
     return data;
 }
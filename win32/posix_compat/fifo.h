@@ -35,9 +35,9 @@ typedef enum
  *
  * @brief Initialize FIFO.
  *
- * @param Length Maximum FIFO length, 0 if unlimited.
+ * @param Length Maximum FIFO length, must not be 0.
  *
- * @retval FIFO handle.
+ * @retval FIFO handle, or NULL on fail.
  */
 FIFO_Handle_t FIFO_Init(unsigned int Length);
 
@@ -0,0 +1,200 @@
+/**
+******************************************************************************
+* @file    mpmc.h
+* @version V1.0
+* @date    16/10/2026
+* @brief   bounded lock-free multi producer multi consumer queue
+* @cite    https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+*/
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef _MPMC_H
+#define _MPMC_H
+/* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#ifdef _WIN32
+# include <windows.h>
+#else
+# include <sched.h>
+#endif
+/* Exported defines --------------------------------------------------------- */
+#define MPMC_CACHE_LINE 64
+/* Exported types ------------------------------------------------------------*/
+
+/* Queue cell, Seq tells whose turn it is */
+typedef struct
+{
+    _Atomic size_t Seq;
+    void *         Data;
+} MPMC_Cell_t;
+
+/* Queue, positions are kept on their own cache lines so producers and
+ * consumers don't bounce the same line */
+typedef struct
+{
+    MPMC_Cell_t *  Cells;
+    size_t         Mask;
+    char           Pad0[MPMC_CACHE_LINE];
+    _Atomic size_t EnqPos;
+    char           Pad1[MPMC_CACHE_LINE - sizeof(size_t)];
+    _Atomic size_t DeqPos;
+    char           Pad2[MPMC_CACHE_LINE - sizeof(size_t)];
+} MPMC_Queue_t;
+/* Exported constants --------------------------------------------------------*/
+/* Exported macro ------------------------------------------------------------*/
+/* Exported functions ------------------------------------------------------- */
+/**
+ * @fn int MPMC_Init(MPMC_Queue_t *Queue, size_t Length)
+ *
+ * @brief Initialize queue, capacity is Length rounded up to a power of two.
+ *
+ * @param Queue Queue to initialize.
+ * @param Length Minimum capacity.
+ *
+ * @retval 0 on success, -1 on fail.
+ */
+static inline int MPMC_Init(MPMC_Queue_t *Queue, size_t Length)
+{
+    size_t size = 1;
+
+    while(size < Length)
+        size <<= 1;
+
+    Queue->Cells = malloc(size * sizeof(MPMC_Cell_t));
+    if(Queue->Cells == NULL)
+        return -1;
+
+    for(size_t i = 0; i < size; i++)
+    {
+        atomic_init(&Queue->Cells[i].Seq, i);
+        Queue->Cells[i].Data = NULL;
+    }
+
+    Queue->Mask = size - 1;
+    atomic_init(&Queue->EnqPos, 0);
+    atomic_init(&Queue->DeqPos, 0);
+
+    return 0;
+}
+
+/**
+ * @fn void MPMC_Deinit(MPMC_Queue_t *Queue)
+ *
+ * @brief De-initialize queue.
+ *
+ * @param Queue Queue handle.
+ */
+static inline void MPMC_Deinit(MPMC_Queue_t *Queue)
+{
+    free(Queue->Cells);
+    Queue->Cells = NULL;
+}
+
+/**
+ * @fn bool MPMC_Enqueue(MPMC_Queue_t *Queue, void *Data)
+ *
+ * @brief Enqueue element without blocking.
+ *
+ * @param Queue Queue handle.
+ * @param Data Element.
+ *
+ * @retval true on success, false if full.
+ */
+static inline bool MPMC_Enqueue(MPMC_Queue_t *Queue, void *Data)
+{
+    MPMC_Cell_t *cell;
+    size_t pos = atomic_load_explicit(&Queue->EnqPos, memory_order_relaxed);
+
+    while(1)
+    {
+        cell = &Queue->Cells[pos & Queue->Mask];
+        size_t seq = atomic_load_explicit(&cell->Seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+        if(dif == 0)
+        {
+            /* Cell is free, claim position */
+            if(atomic_compare_exchange_weak_explicit(&Queue->EnqPos, &pos, pos + 1,
+                                                     memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if(dif < 0)
+        {
+            /* Cell still holds the element of the previous lap */
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&Queue->EnqPos, memory_order_relaxed);
+        }
+    }
+
+    cell->Data = Data;
+    atomic_store_explicit(&cell->Seq, pos + 1, memory_order_release);
+
+    return true;
+}
+
+/**
+ * @fn bool MPMC_Dequeue(MPMC_Queue_t *Queue, void **Data)
+ *
+ * @brief Dequeue element without blocking.
+ *
+ * @param Queue Queue handle.
+ * @param Data Set to element.
+ *
+ * @retval true on success, false if empty.
+ */
+static inline bool MPMC_Dequeue(MPMC_Queue_t *Queue, void **Data)
+{
+    MPMC_Cell_t *cell;
+    size_t pos = atomic_load_explicit(&Queue->DeqPos, memory_order_relaxed);
+
+    while(1)
+    {
+        cell = &Queue->Cells[pos & Queue->Mask];
+        size_t seq = atomic_load_explicit(&cell->Seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if(dif == 0)
+        {
+            /* Cell is filled, claim position */
+            if(atomic_compare_exchange_weak_explicit(&Queue->DeqPos, &pos, pos + 1,
+                                                     memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if(dif < 0)
+        {
+            /* Cell not written yet */
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&Queue->DeqPos, memory_order_relaxed);
+        }
+    }
+
+    *Data = cell->Data;
+    atomic_store_explicit(&cell->Seq, pos + Queue->Mask + 1, memory_order_release);
+
+    return true;
+}
+
+/**
+ * @fn void MPMC_Yield(void)
+ *
+ * @brief Give way to a thread which is in the middle of an operation.
+ */
+static inline void MPMC_Yield(void)
+{
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+#endif
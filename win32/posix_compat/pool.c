@@ -0,0 +1,137 @@
+/**
+******************************************************************************
+* @file    pool.c
+* @version V1.0
+* @date    16/10/2026
+* @brief   thread-safe fixed size block pool
+*/
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdlib.h>
+#include "pool.h"
+#include "mpmc.h"
+/* Private typedef -----------------------------------------------------------*/
+/* Pool handle */
+struct _POOL_t
+{
+    MPMC_Queue_t Free;
+    uint8_t *    Slab;
+    size_t       BlockSize;
+    unsigned int Count;
+};
+/* Private define ------------------------------------------------------------*/
+/* Block alignment, suits any element type */
+#define POOL_ALIGN 16
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+/**
+ * @fn POOL_Handle_t POOL_Init(size_t BlockSize, unsigned int Count)
+ *
+ * @brief Initialize pool of Count blocks of BlockSize bytes in one slab.
+ *
+ * @param BlockSize Block size.
+ * @param Count Block count.
+ *
+ * @retval Pool handle, or NULL on fail.
+ */
+POOL_Handle_t POOL_Init(size_t BlockSize, unsigned int Count)
+{
+    if(BlockSize == 0 || Count == 0)
+        return NULL;
+
+    POOL_Handle_t POOL = malloc(sizeof(struct _POOL_t));
+    if(POOL == NULL)
+        return NULL;
+
+    BlockSize = (BlockSize + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+
+    POOL->Slab = malloc(BlockSize * Count);
+    if(POOL->Slab == NULL)
+    {
+        free(POOL);
+        return NULL;
+    }
+
+    if(MPMC_Init(&POOL->Free, Count) != 0)
+    {
+        free(POOL->Slab);
+        free(POOL);
+        return NULL;
+    }
+
+    POOL->BlockSize = BlockSize;
+    POOL->Count     = Count;
+
+    for(unsigned int i = 0; i < Count; i++)
+        MPMC_Enqueue(&POOL->Free, POOL->Slab + i * BlockSize);
+
+    return POOL;
+}
+
+/**
+ * @fn int POOL_Deinit(POOL_Handle_t hPOOL)
+ *
+ * @brief De-initialize pool, all blocks must have been freed.
+ *
+ * @param hPOOL Pool handle.
+ *
+ * @retval 0 on success, -1 on fail.
+ */
+int POOL_Deinit(POOL_Handle_t hPOOL)
+{
+    if(!hPOOL)
+        return -1;
+
+    MPMC_Deinit(&hPOOL->Free);
+    free(hPOOL->Slab);
+    free(hPOOL);
+
+    return 0;
+}
+
+/**
+ * @fn void *POOL_Alloc(POOL_Handle_t hPOOL, size_t Size)
+ *
+ * @brief Allocate memory, from the pool if Size fits in a block and one is
+ *        free, from the heap otherwise.
+ *
+ * @param hPOOL Pool handle.
+ * @param Size Size to allocate.
+ *
+ * @retval Pointer to memory, or NULL on fail.
+ */
+void *POOL_Alloc(POOL_Handle_t hPOOL, size_t Size)
+{
+    void *data;
+
+    if(Size <= hPOOL->BlockSize && MPMC_Dequeue(&hPOOL->Free, &data))
+        return data;
+
+    return malloc(Size);
+}
+
+/**
+ * @fn void POOL_Free(POOL_Handle_t hPOOL, void *Data)
+ *
+ * @brief Free memory allocated with POOL_Alloc().
+ *
+ * @param hPOOL Pool handle.
+ * @param Data Pointer to memory.
+ */
+void POOL_Free(POOL_Handle_t hPOOL, void *Data)
+{
+    uint8_t *data = (uint8_t *)Data;
+
+    if(data >= hPOOL->Slab && data < hPOOL->Slab + hPOOL->BlockSize * hPOOL->Count)
+    {
+        /* Queue holds every block, so there is always room */
+        while(!MPMC_Enqueue(&hPOOL->Free, Data))
+            MPMC_Yield();
+    }
+    else
+    {
+        free(Data);
+    }
+}
@@ -0,0 +1,67 @@
+/**
+******************************************************************************
+* @file    pool.h
+* @version V1.0
+* @date    16/10/2026
+* @brief   thread-safe fixed size block pool
+*/
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef _POOL_H
+#define _POOL_H
+/* Includes ------------------------------------------------------------------*/
+#include <stddef.h>
+/* Exported defines --------------------------------------------------------- */
+/* Exported types ------------------------------------------------------------*/
+
+/* Pool handle */
+typedef struct _POOL_t *POOL_Handle_t;
+/* Exported constants --------------------------------------------------------*/
+/* Exported macro ------------------------------------------------------------*/
+/* Exported functions ------------------------------------------------------- */
+/**
+ * @fn POOL_Handle_t POOL_Init(size_t BlockSize, unsigned int Count)
+ *
+ * @brief Initialize pool of Count blocks of BlockSize bytes in one slab.
+ *
+ * @param BlockSize Block size.
+ * @param Count Block count.
+ *
+ * @retval Pool handle, or NULL on fail.
+ */
+POOL_Handle_t POOL_Init(size_t BlockSize, unsigned int Count);
+
+/**
+ * @fn int POOL_Deinit(POOL_Handle_t hPOOL)
+ *
+ * @brief De-initialize pool, all blocks must have been freed.
+ *
+ * @param hPOOL Pool handle.
+ *
+ * @retval 0 on success, -1 on fail.
+ */
+int POOL_Deinit(POOL_Handle_t hPOOL);
+
+/**
+ * @fn void *POOL_Alloc(POOL_Handle_t hPOOL, size_t Size)
+ *
+ * @brief Allocate memory, from the pool if Size fits in a block and one is
+ *        free, from the heap otherwise.
+ *
+ * @param hPOOL Pool handle.
+ * @param Size Size to allocate.
+ *
+ * @retval Pointer to memory, or NULL on fail.
+ */
+void *POOL_Alloc(POOL_Handle_t hPOOL, size_t Size);
+
+/**
+ * @fn void POOL_Free(POOL_Handle_t hPOOL, void *Data)
+ *
+ * @brief Free memory allocated with POOL_Alloc().
+ *
+ * @param hPOOL Pool handle.
+ * @param Data Pointer to memory.
+ */
+void POOL_Free(POOL_Handle_t hPOOL, void *Data);
+
+#endif
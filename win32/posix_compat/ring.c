@@ -8,7 +8,17 @@
 * @cite    https://www.snellman.net/blog/archive/2016-12-13-ring-buffers/
 */
 /* Includes ------------------------------------------------------------------*/
+#define _GNU_SOURCE
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+# include <windows.h>
+#else
+# include <unistd.h>
+# include <sys/mman.h>
+#endif
 #include "ring.h"
 #include "semaphore.h"
 #include "cthread.h"
@@ -24,6 +34,12 @@ struct _RING_t
     uint32_t Size;
     uint32_t IdxRead;
     uint32_t IdxWrite;
+    /* SPSC mode, indices run freely and are masked */
+    bool Spsc;
+    /* Buffer is mapped twice back to back, every span is contiguous */
+    bool Mirror;
+    _Atomic uint32_t Head;
+    _Atomic uint32_t Tail;
 };
 /* Private define ------------------------------------------------------------*/
 /* Private macro -------------------------------------------------------------*/
@@ -37,11 +53,217 @@ struct _RING_t
 /* Private function prototypes -----------------------------------------------*/
 static inline uint32_t mask(RING_Handle_t hRING, uint32_t val) { return val % hRING->Size; }
 static inline uint32_t wrap(RING_Handle_t hRING, uint32_t val) { return val % (hRING->Size * 2); }
-static inline uint32_t count(RING_Handle_t hRING)              { return wrap(hRING, hRING->IdxWrite - hRING->IdxRead); }
+static inline uint32_t count(RING_Handle_t hRING)              { return wrap(hRING, hRING->IdxWrite + hRING->Size * 2 - hRING->IdxRead); }
 static inline bool empty(RING_Handle_t hRING)                  { return hRING->IdxRead == hRING->IdxWrite; }
 static inline bool full(RING_Handle_t hRING)                   { return count(hRING) == hRING->Size; }
+static inline uint32_t spsc_mask(RING_Handle_t hRING, uint32_t val) { return val & (hRING->Size - 1); }
+static inline uint32_t spsc_count(RING_Handle_t hRING)
+{
+    /* Head first, so a concurrent write can't make the count negative */
+    uint32_t head = atomic_load_explicit(&hRING->Head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&hRING->Tail, memory_order_acquire);
+    return min(tail - head, hRING->Size);
+}
 /* Private functions ---------------------------------------------------------*/
 
+/*
+ * SPSC mode: the writer owns Tail and the reader owns Head, each published
+ * with release and read with acquire ordering, so no lock is needed.
+ *
+ * SemAvail is kept signaled while the ring is not empty and SemFree while it
+ * is not full, but they are only touched on empty <-> non-empty and
+ * full <-> non-full transitions. After clearing an event the side that
+ * cleared it checks the other index again (after a full fence, pairing with
+ * the one of the other side), and signals it back if the other side moved
+ * meanwhile, so a wakeup can't get lost.
+ */
+static void RING_Commit_Spsc(RING_Handle_t hRING, uint32_t tail, uint32_t Length)
+{
+    atomic_store_explicit(&hRING->Tail, tail + Length, memory_order_release);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    uint32_t head = atomic_load_explicit(&hRING->Head, memory_order_acquire);
+
+    /* Empty -> non-empty */
+    if(tail == head)
+        SEM_Give(hRING->SemAvail);
+
+    /* Non-full -> full */
+    if(tail + Length - head == hRING->Size)
+    {
+        SEM_Take(hRING->SemFree);
+        atomic_thread_fence(memory_order_seq_cst);
+        if(tail + Length - atomic_load_explicit(&hRING->Head, memory_order_acquire) != hRING->Size)
+            SEM_Give(hRING->SemFree);
+    }
+}
+
+static void RING_Release_Spsc(RING_Handle_t hRING, uint32_t head, uint32_t Length)
+{
+    atomic_store_explicit(&hRING->Head, head + Length, memory_order_release);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    uint32_t tail = atomic_load_explicit(&hRING->Tail, memory_order_acquire);
+
+    /* Full -> non-full */
+    if(tail - head == hRING->Size)
+        SEM_Give(hRING->SemFree);
+
+    /* Non-empty -> empty */
+    if(tail == head + Length)
+    {
+        SEM_Take(hRING->SemAvail);
+        atomic_thread_fence(memory_order_seq_cst);
+        if(atomic_load_explicit(&hRING->Tail, memory_order_acquire) != head + Length)
+            SEM_Give(hRING->SemAvail);
+    }
+}
+
+static uint32_t RING_Write_Spsc(RING_Handle_t hRING, const uint8_t *data, uint32_t Length)
+{
+    uint32_t tail = atomic_load_explicit(&hRING->Tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&hRING->Head, memory_order_acquire);
+
+    Length = min(Length, hRING->Size - (tail - head));
+    if(Length == 0)
+        return 0;
+
+    uint32_t run = min(Length, hRING->Size - spsc_mask(hRING, tail));
+
+    memcpy(hRING->Buffer + spsc_mask(hRING, tail), data, run);
+    memcpy(hRING->Buffer, data + run, Length - run);
+    RING_Commit_Spsc(hRING, tail, Length);
+
+    return Length;
+}
+
+static uint32_t RING_Read_Spsc(RING_Handle_t hRING, uint8_t *data, uint32_t Length)
+{
+    uint32_t head = atomic_load_explicit(&hRING->Head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&hRING->Tail, memory_order_acquire);
+
+    Length = min(Length, tail - head);
+    if(Length == 0)
+        return 0;
+
+    uint32_t run = min(Length, hRING->Size - spsc_mask(hRING, head));
+
+    memcpy(data, hRING->Buffer + spsc_mask(hRING, head), run);
+    memcpy(data + run, hRING->Buffer, Length - run);
+    RING_Release_Spsc(hRING, head, Length);
+
+    return Length;
+}
+
+/*
+ * Mirror mode: the same pages are mapped twice back to back, so a span
+ * starting anywhere in the first mapping can run over its end into the
+ * second one. Length must be a multiple of the page size (allocation
+ * granularity on Windows).
+ */
+#ifdef _WIN32
+static uint8_t *RING_Map_Mirror(uint32_t Length)
+{
+    SYSTEM_INFO info;
+    uint8_t *base = NULL;
+
+    GetSystemInfo(&info);
+    if(Length % info.dwAllocationGranularity)
+        return NULL;
+
+    HANDLE hMap = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, Length, NULL);
+    if(hMap == NULL)
+        return NULL;
+
+    /* Find a free address range, then map both views into it. Another
+     * thread may grab the range meanwhile, so retry a few times. */
+    for(int i = 0; i < 16 && base == NULL; i++)
+    {
+        uint8_t *addr = VirtualAlloc(NULL, 2 * (SIZE_T)Length, MEM_RESERVE, PAGE_NOACCESS);
+        if(addr == NULL)
+            break;
+        VirtualFree(addr, 0, MEM_RELEASE);
+
+        if(MapViewOfFileEx(hMap, FILE_MAP_ALL_ACCESS, 0, 0, Length, addr) != addr)
+            continue;
+        if(MapViewOfFileEx(hMap, FILE_MAP_ALL_ACCESS, 0, 0, Length, addr + Length) != addr + Length)
+        {
+            UnmapViewOfFile(addr);
+            continue;
+        }
+        base = addr;
+    }
+
+    /* Views keep the section alive */
+    CloseHandle(hMap);
+
+    return base;
+}
+
+static void RING_Unmap_Mirror(uint8_t *Buffer, uint32_t Length)
+{
+    UnmapViewOfFile(Buffer + Length);
+    UnmapViewOfFile(Buffer);
+}
+#else
+static uint8_t *RING_Map_Mirror(uint32_t Length)
+{
+    if(Length % sysconf(_SC_PAGESIZE))
+        return NULL;
+
+    int fd = memfd_create("ring", MFD_CLOEXEC);
+    if(fd < 0)
+        return NULL;
+
+    if(ftruncate(fd, Length) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    /* Reserve the whole range first so nothing else lands in between */
+    uint8_t *base = mmap(NULL, 2 * (size_t)Length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(base == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    if(mmap(base, Length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+       mmap(base + Length, Length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        munmap(base, 2 * (size_t)Length);
+        close(fd);
+        return NULL;
+    }
+
+    /* Mappings keep the memory alive */
+    close(fd);
+
+    return base;
+}
+
+static void RING_Unmap_Mirror(uint8_t *Buffer, uint32_t Length)
+{
+    munmap(Buffer, 2 * (size_t)Length);
+}
+#endif
+
+static void RING_Setup(RING_Handle_t RING, uint32_t Length)
+{
+    pthread_mutex_init(&RING->Lock, NULL);
+    RING->SemFree = SEM_Init(1, true);
+    RING->SemAvail = SEM_Init(0, true);
+
+    RING->Size = Length;
+    RING->IdxRead  = 0;
+    RING->IdxWrite = 0;
+    RING->Spsc = false;
+    RING->Mirror = false;
+    atomic_init(&RING->Head, 0);
+    atomic_init(&RING->Tail, 0);
+}
+
 /**
  * @fn RING_Handle_t RING_Init(uint32_t Length)
  *
@@ -64,13 +286,65 @@ RING_Handle_t RING_Init(uint32_t Length)
     if(RING->Buffer == NULL)
         return NULL;
 
-    pthread_mutex_init(&RING->Lock, NULL);
-    RING->SemFree = SEM_Init(1, true);
-    RING->SemAvail = SEM_Init(0, true);
+    RING_Setup(RING, Length);
 
-    RING->Size = Length;
-    RING->IdxRead  = 0;
-    RING->IdxWrite = 0;
+    return RING;
+}
+
+/**
+ * @fn RING_Handle_t RING_Init_SPSC(uint32_t Length)
+ *
+ * @brief Initialize lock-free single producer single consumer ring buffer.
+ *
+ * @param Length Ring buffer size, must be a power of two <= 1 GiB.
+ *
+ * @retval Ring buffer handle, or NULL on fail.
+ */
+RING_Handle_t RING_Init_SPSC(uint32_t Length)
+{
+    if(Length & (Length - 1))
+        return NULL;
+
+    RING_Handle_t RING = RING_Init(Length);
+    if(RING == NULL)
+        return NULL;
+
+    RING->Spsc = true;
+
+    return RING;
+}
+
+/**
+ * @fn RING_Handle_t RING_Init_Mirror(uint32_t Length)
+ *
+ * @brief Initialize lock-free single producer single consumer ring buffer
+ *        whose memory is mapped twice back to back, so spans returned by
+ *        RING_WriteReserve() and RING_ReadPeek() never wrap.
+ *
+ * @param Length Ring buffer size, must be a power of two multiple of the
+ *        page size (64 KiB on Windows) <= 1 GiB.
+ *
+ * @retval Ring buffer handle, or NULL on fail.
+ */
+RING_Handle_t RING_Init_Mirror(uint32_t Length)
+{
+    if(Length == 0 || Length > 0x40000000 || (Length & (Length - 1)))
+        return NULL;
+
+    RING_Handle_t RING = malloc(sizeof(struct _RING_t));
+    if(RING == NULL)
+        return NULL;
+
+    RING->Buffer = RING_Map_Mirror(Length);
+    if(RING->Buffer == NULL)
+    {
+        free(RING);
+        return NULL;
+    }
+
+    RING_Setup(RING, Length);
+    RING->Spsc = true;
+    RING->Mirror = true;
 
     return RING;
 }
@@ -94,7 +368,10 @@ int RING_Deinit(RING_Handle_t hRING)
 
     pthread_mutex_destroy(&hRING->Lock);
 
-    free(hRING->Buffer);
+    if(hRING->Mirror)
+        RING_Unmap_Mirror(hRING->Buffer, hRING->Size);
+    else
+        free(hRING->Buffer);
     free(hRING);
 
     return 0;
@@ -115,6 +392,9 @@ uint32_t RING_Write(RING_Handle_t hRING, const void *Data, uint32_t Length)
 {
     const uint8_t* data = (const uint8_t*)Data;
 
+    if(hRING->Spsc)
+        return RING_Write_Spsc(hRING, data, Length);
+
     pthread_mutex_lock(&hRING->Lock);
 
     Length = min(Length, hRING->Size - count(hRING));
@@ -152,6 +432,9 @@ uint32_t RING_Read(RING_Handle_t hRING, void *Data, uint32_t Length)
 {
     uint8_t* data = (uint8_t*)Data;
 
+    if(hRING->Spsc)
+        return RING_Read_Spsc(hRING, data, Length);
+
     pthread_mutex_lock(&hRING->Lock);
 
     Length = min(Length, count(hRING));
@@ -232,6 +515,176 @@ int RING_Read_Blocking(RING_Handle_t hRING, void *Data, uint32_t Length)
     return 0;
 }
 
+/**
+ * @fn uint32_t RING_WriteReserve(RING_Handle_t hRING, void **Data)
+ *
+ * @brief Get contiguous free space to write into directly, the data only
+ *        becomes visible to the reader with RING_WriteCommit().
+ *
+ * @param hRING Ring buffer handle.
+ * @param Data Set to the start of the free space.
+ *
+ * @retval Contiguous free bytes, 0 if full.
+ */
+uint32_t RING_WriteReserve(RING_Handle_t hRING, void **Data)
+{
+    uint32_t size;
+
+    if(hRING->Spsc)
+    {
+        uint32_t tail = atomic_load_explicit(&hRING->Tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(&hRING->Head, memory_order_acquire);
+
+        size = hRING->Size - (tail - head);
+        if(!hRING->Mirror)
+            size = min(size, hRING->Size - spsc_mask(hRING, tail));
+        *Data = hRING->Buffer + spsc_mask(hRING, tail);
+
+        return size;
+    }
+
+    pthread_mutex_lock(&hRING->Lock);
+
+    size = min(hRING->Size - count(hRING), hRING->Size - mask(hRING, hRING->IdxWrite));
+    *Data = hRING->Buffer + mask(hRING, hRING->IdxWrite);
+
+    pthread_mutex_unlock(&hRING->Lock);
+
+    return size;
+}
+
+/**
+ * @fn int RING_WriteCommit(RING_Handle_t hRING, uint32_t Length)
+ *
+ * @brief Make data written into reserved space visible to the reader.
+ *
+ * @param hRING Ring buffer handle.
+ * @param Length Bytes written, must not exceed the reserved size.
+ *
+ * @retval 0 on success, -1 on fail.
+ */
+int RING_WriteCommit(RING_Handle_t hRING, uint32_t Length)
+{
+    if(Length == 0)
+        return 0;
+
+    if(hRING->Spsc)
+    {
+        uint32_t tail = atomic_load_explicit(&hRING->Tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(&hRING->Head, memory_order_acquire);
+
+        if(Length > hRING->Size - (tail - head))
+            return -1;
+
+        RING_Commit_Spsc(hRING, tail, Length);
+
+        return 0;
+    }
+
+    pthread_mutex_lock(&hRING->Lock);
+
+    if(Length > hRING->Size - count(hRING))
+    {
+        pthread_mutex_unlock(&hRING->Lock);
+        return -1;
+    }
+
+    hRING->IdxWrite = wrap(hRING, hRING->IdxWrite + Length);
+
+    SEM_Give(hRING->SemAvail);
+    if(full(hRING))
+        SEM_Take(hRING->SemFree);
+
+    pthread_mutex_unlock(&hRING->Lock);
+
+    return 0;
+}
+
+/**
+ * @fn uint32_t RING_ReadPeek(RING_Handle_t hRING, void **Data)
+ *
+ * @brief Get contiguous available data to process in place, the space is
+ *        only handed back to the writer with RING_ReadRelease().
+ *
+ * @param hRING Ring buffer handle.
+ * @param Data Set to the start of the available data.
+ *
+ * @retval Contiguous available bytes, 0 if empty.
+ */
+uint32_t RING_ReadPeek(RING_Handle_t hRING, void **Data)
+{
+    uint32_t size;
+
+    if(hRING->Spsc)
+    {
+        uint32_t head = atomic_load_explicit(&hRING->Head, memory_order_relaxed);
+        uint32_t tail = atomic_load_explicit(&hRING->Tail, memory_order_acquire);
+
+        size = tail - head;
+        if(!hRING->Mirror)
+            size = min(size, hRING->Size - spsc_mask(hRING, head));
+        *Data = hRING->Buffer + spsc_mask(hRING, head);
+
+        return size;
+    }
+
+    pthread_mutex_lock(&hRING->Lock);
+
+    size = min(count(hRING), hRING->Size - mask(hRING, hRING->IdxRead));
+    *Data = hRING->Buffer + mask(hRING, hRING->IdxRead);
+
+    pthread_mutex_unlock(&hRING->Lock);
+
+    return size;
+}
+
+/**
+ * @fn int RING_ReadRelease(RING_Handle_t hRING, uint32_t Length)
+ *
+ * @brief Hand space of processed data back to the writer.
+ *
+ * @param hRING Ring buffer handle.
+ * @param Length Bytes processed, must not exceed the available size.
+ *
+ * @retval 0 on success, -1 on fail.
+ */
+int RING_ReadRelease(RING_Handle_t hRING, uint32_t Length)
+{
+    if(Length == 0)
+        return 0;
+
+    if(hRING->Spsc)
+    {
+        uint32_t head = atomic_load_explicit(&hRING->Head, memory_order_relaxed);
+        uint32_t tail = atomic_load_explicit(&hRING->Tail, memory_order_acquire);
+
+        if(Length > tail - head)
+            return -1;
+
+        RING_Release_Spsc(hRING, head, Length);
+
+        return 0;
+    }
+
+    pthread_mutex_lock(&hRING->Lock);
+
+    if(Length > count(hRING))
+    {
+        pthread_mutex_unlock(&hRING->Lock);
+        return -1;
+    }
+
+    hRING->IdxRead = wrap(hRING, hRING->IdxRead + Length);
+
+    SEM_Give(hRING->SemFree);
+    if(empty(hRING))
+        SEM_Take(hRING->SemAvail);
+
+    pthread_mutex_unlock(&hRING->Lock);
+
+    return 0;
+}
+
 /**
  * @fn uint32_t RING_Get_Count(RING_Handle_t hRING)
  *
@@ -245,6 +698,9 @@ uint32_t RING_Get_Count(RING_Handle_t hRING)
 {
     uint32_t size;
 
+    if(hRING->Spsc)
+        return spsc_count(hRING);
+
     pthread_mutex_lock(&hRING->Lock);
 
     size = count(hRING);
@@ -267,6 +723,9 @@ uint32_t RING_Get_Free(RING_Handle_t hRING)
 {
     uint32_t size;
 
+    if(hRING->Spsc)
+        return hRING->Size - spsc_count(hRING);
+
     pthread_mutex_lock(&hRING->Lock);
 
     size = hRING->Size - count(hRING);
@@ -43,6 +43,31 @@ typedef enum
  */
 RING_Handle_t RING_Init(uint32_t Length);
 
+/**
+ * @fn RING_Handle_t RING_Init_SPSC(uint32_t Length)
+ *
+ * @brief Initialize lock-free single producer single consumer ring buffer.
+ *        Only one thread may write and only one thread may read it.
+ *
+ * @param Length Ring buffer size, must be a power of two <= 1 GiB.
+ *
+ * @retval Ring buffer handle, or NULL on fail.
+ */
+RING_Handle_t RING_Init_SPSC(uint32_t Length);
+
+/**
+ * @fn RING_Handle_t RING_Init_Mirror(uint32_t Length)
+ *
+ * @brief Initialize lock-free single producer single consumer ring buffer
+ *        mapped twice back to back, so reserved and peeked spans never wrap.
+ *
+ * @param Length Ring buffer size, must be a power of two multiple of the
+ *        page size (64 KiB on Windows) <= 1 GiB.
+ *
+ * @retval Ring buffer handle, or NULL on fail.
+ */
+RING_Handle_t RING_Init_Mirror(uint32_t Length);
+
 /**
  * @fn RING_Handle_t RING_Deinit(RING_Handle_t hRING)
  *
@@ -106,6 +131,54 @@ int RING_Write_Blocking(RING_Handle_t hRING, const void *Data, uint32_t Length);
  */
 int RING_Read_Blocking(RING_Handle_t hRING, void *Data, uint32_t Length);
 
+/**
+ * @fn uint32_t RING_WriteReserve(RING_Handle_t hRING, void **Data)
+ *
+ * @brief Get contiguous free space to write into directly.
+ *
+ * @param hRING Ring buffer handle.
+ * @param Data Set to the start of the free space.
+ *
+ * @retval Contiguous free bytes, 0 if full.
+ */
+uint32_t RING_WriteReserve(RING_Handle_t hRING, void **Data);
+
+/**
+ * @fn int RING_WriteCommit(RING_Handle_t hRING, uint32_t Length)
+ *
+ * @brief Make data written into reserved space visible to the reader.
+ *
+ * @param hRING Ring buffer handle.
+ * @param Length Bytes written, must not exceed the reserved size.
+ *
+ * @retval 0 on success, -1 on fail.
+ */
+int RING_WriteCommit(RING_Handle_t hRING, uint32_t Length);
+
+/**
+ * @fn uint32_t RING_ReadPeek(RING_Handle_t hRING, void **Data)
+ *
+ * @brief Get contiguous available data to process in place.
+ *
+ * @param hRING Ring buffer handle.
+ * @param Data Set to the start of the available data.
+ *
+ * @retval Contiguous available bytes, 0 if empty.
+ */
+uint32_t RING_ReadPeek(RING_Handle_t hRING, void **Data);
+
+/**
+ * @fn int RING_ReadRelease(RING_Handle_t hRING, uint32_t Length)
+ *
+ * @brief Hand space of processed data back to the writer.
+ *
+ * @param hRING Ring buffer handle.
+ * @param Length Bytes processed, must not exceed the available size.
+ *
+ * @retval 0 on success, -1 on fail.
+ */
+int RING_ReadRelease(RING_Handle_t hRING, uint32_t Length);
+
 /**
  * @fn uint32_t RING_Get_Count(RING_Handle_t hRING)
  *
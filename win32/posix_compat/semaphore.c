@@ -17,9 +17,15 @@
 # include <fcntl.h>
 # include <pthread.h>
 #else
+# include <errno.h>
+# include <limits.h>
+# include <time.h>
 # include <unistd.h>
-# include <poll.h>
+# include <pthread.h>
+# include <stdatomic.h>
 # include <sys/eventfd.h>
+# include <sys/syscall.h>
+# include <linux/futex.h>
 #endif
 #include "semaphore.h"
 /* Private defines --------------------------------------------------------- */
@@ -36,13 +42,53 @@ struct _SEM_Handle_t
     pthread_mutex_t Lock;
     bool Event;
 #else
-    int fd;
+    _Atomic uint32_t Cnt;
+    _Atomic uint32_t Waiters;
+    _Atomic int fd;
+    pthread_mutex_t Lock;
+    bool Signaled;
+    bool Event;
 #endif
 };
 /* Private types ------------------------------------------------------------*/
 /* Private constants --------------------------------------------------------*/
 /* Private macro ------------------------------------------------------------*/
 /* Private functions ------------------------------------------------------- */
+#if !defined(_WIN32) && !defined(__CYGWIN__)
+/*
+ * Linux: the count lives in user space, give and take are plain atomics
+ * and blocked SEM_Wait() callers sleep on a futex, so nothing enters the
+ * kernel unless somebody waits.
+ *
+ * The eventfd is only created by SEM_GetWaitable(). From then on it is
+ * kept readable while the count is not zero, it is only written or
+ * drained on zero <-> non-zero transitions. Sync() runs after each such
+ * transition and copies the count state under the lock, so the last one
+ * to run always sees the latest count.
+ */
+static void Sync(SEM_Handle_t hSem)
+{
+    /* Checked under the lock, arming may be in progress */
+    pthread_mutex_lock(&hSem->Lock);
+    int fd = atomic_load(&hSem->fd);
+    bool signaled = atomic_load(&hSem->Cnt) != 0;
+    if(fd >= 0 && signaled != hSem->Signaled)
+    {
+        if(signaled)
+            write(fd, &(uint64_t){1}, sizeof(uint64_t));
+        else
+            read(fd, &(uint64_t){0}, sizeof(uint64_t));
+        hSem->Signaled = signaled;
+    }
+    pthread_mutex_unlock(&hSem->Lock);
+}
+
+static int Futex(_Atomic uint32_t *Addr, int Op, uint32_t Val, const struct timespec *Timeout)
+{
+    return syscall(SYS_futex, Addr, Op | FUTEX_PRIVATE_FLAG, Val, Timeout, NULL, 0);
+}
+#endif
+
 /**
  * @fn SEM_Handle_t SEM_Init(uint32_t InitVal)
  *
@@ -81,8 +127,14 @@ SEM_Handle_t SEM_Init(uint32_t InitVal, bool Event)
     hSem->Cnt = InitVal;
     hSem->Event = Event;
 #else
-    if(hSem->fd = eventfd(InitVal, Event ? EFD_NONBLOCK : EFD_SEMAPHORE | EFD_NONBLOCK), hSem->fd < 0)
+    if(pthread_mutex_init(&hSem->Lock, NULL) != 0)
         goto err;
+    if(InitVal && Event) InitVal = 1;
+    atomic_init(&hSem->Cnt, InitVal);
+    atomic_init(&hSem->Waiters, 0);
+    atomic_init(&hSem->fd, -1);
+    hSem->Signaled = false;
+    hSem->Event = Event;
 #endif
 
     return hSem;
@@ -112,7 +164,9 @@ int SEM_Deinit(SEM_Handle_t hSem)
     close(hSem->fd[1]);
     pthread_mutex_destroy(&hSem->Lock);
 #else
-    close(hSem->fd);
+    if(atomic_load(&hSem->fd) >= 0)
+        close(hSem->fd);
+    pthread_mutex_destroy(&hSem->Lock);
 #endif
 
     free(hSem);
@@ -151,7 +205,20 @@ int SEM_Give(SEM_Handle_t hSem)
         hSem->Cnt++;
     pthread_mutex_unlock(&hSem->Lock);
 #else
-    write(hSem->fd, &(uint64_t){1}, sizeof(uint64_t));
+    uint32_t cnt = atomic_load_explicit(&hSem->Cnt, memory_order_relaxed);
+    do
+    {
+        if(cnt == UINT32_MAX - 1 || (hSem->Event && cnt))
+            return 0;
+    } while(!atomic_compare_exchange_weak(&hSem->Cnt, &cnt, hSem->Event ? 1 : cnt + 1));
+
+    /* Events wake every waiter, semaphores one which passes it on */
+    if(!cnt)
+    {
+        if(atomic_load(&hSem->Waiters))
+            Futex(&hSem->Cnt, FUTEX_WAKE, hSem->Event ? INT_MAX : 1, NULL);
+        Sync(hSem);
+    }
 #endif
 
     return 0;
@@ -192,8 +259,17 @@ int SEM_Take(SEM_Handle_t hSem)
         read(hSem->fd[0], &(uint8_t){1}, 1);
     pthread_mutex_unlock(&hSem->Lock);
 #else
-    if(read(hSem->fd, &(uint64_t){1}, sizeof(uint64_t)) > 0)
-        ret = 0;
+    uint32_t cnt = atomic_load_explicit(&hSem->Cnt, memory_order_relaxed);
+    while(cnt)
+    {
+        if(atomic_compare_exchange_weak(&hSem->Cnt, &cnt, hSem->Event ? 0 : cnt - 1))
+        {
+            if(hSem->Event || cnt == 1)
+                Sync(hSem);
+            ret = 0;
+            break;
+        }
+    }
 #endif
 
     return ret;
@@ -217,7 +293,27 @@ SEM_HANDLE SEM_GetWaitable(SEM_Handle_t hSem)
 #elif __CYGWIN__
     return hSem->fd[0];
 #else
-    return hSem->fd;
+    int fd = atomic_load(&hSem->fd);
+    if(fd >= 0)
+        return fd;
+
+    /* Arm eventfd on first use */
+    pthread_mutex_lock(&hSem->Lock);
+    fd = atomic_load(&hSem->fd);
+    if(fd < 0)
+    {
+        fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(fd >= 0)
+        {
+            hSem->Signaled = atomic_load(&hSem->Cnt) != 0;
+            if(hSem->Signaled)
+                write(fd, &(uint64_t){1}, sizeof(uint64_t));
+            atomic_store(&hSem->fd, fd);
+        }
+    }
+    pthread_mutex_unlock(&hSem->Lock);
+
+    return fd;
 #endif
 }
 
@@ -236,10 +332,10 @@ int SEM_Wait(SEM_Handle_t hSem, int Timeout, bool Take)
 {
     if(!hSem) return -1;
 
-    /* Restart wait until sucessfully taken */
-restart:
 #ifdef _WIN32
     if(Timeout < 0) Timeout = INFINITE;
+    /* Restart wait until sucessfully taken */
+restart:;
     DWORD ret = WaitForSingleObject(hSem->Hdl, Timeout);
 
     if(ret == WAIT_OBJECT_0)
@@ -251,14 +347,12 @@ restart:
     if(ret == WAIT_TIMEOUT)
         return 0;
     return -1;
-#else
+#elif __CYGWIN__
     struct pollfd pollfds[1];
-# ifdef __CYGWIN__
     pollfds[0].fd = hSem->fd[0];
-# else
-    pollfds[0].fd = hSem->fd;
-# endif
     pollfds[0].events = POLLIN;
+    /* Restart wait until sucessfully taken */
+restart:;
     int ret = poll(pollfds, 1, Timeout);
 
     if(ret == 1)
@@ -269,5 +363,55 @@ restart:
     }
 
     return ret;
+#else
+    struct timespec deadline, remain;
+
+    if(Timeout >= 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec  += Timeout / 1000;
+        deadline.tv_nsec += (Timeout % 1000) * 1000000L;
+        if(deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    while(1)
+    {
+        if(Take ? SEM_Take(hSem) == 0 : atomic_load(&hSem->Cnt) != 0)
+        {
+            /* Units are left, wake the next waiter */
+            if(!hSem->Event && atomic_load(&hSem->Cnt) && atomic_load(&hSem->Waiters))
+                Futex(&hSem->Cnt, FUTEX_WAKE, 1, NULL);
+            return 1;
+        }
+
+        if(Timeout >= 0)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &remain);
+            remain.tv_sec  = deadline.tv_sec - remain.tv_sec;
+            remain.tv_nsec = deadline.tv_nsec - remain.tv_nsec;
+            if(remain.tv_nsec < 0)
+            {
+                remain.tv_sec--;
+                remain.tv_nsec += 1000000000L;
+            }
+            if(remain.tv_sec < 0)
+                return 0;
+        }
+
+        /* Register before the last check so SEM_Give() can't miss us */
+        atomic_fetch_add(&hSem->Waiters, 1);
+        if(atomic_load(&hSem->Cnt) == 0 &&
+           Futex(&hSem->Cnt, FUTEX_WAIT, 0, Timeout >= 0 ? &remain : NULL) < 0 &&
+           errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT)
+        {
+            atomic_fetch_sub(&hSem->Waiters, 1);
+            return -1;
+        }
+        atomic_fetch_sub(&hSem->Waiters, 1);
+    }
 #endif
 }
\ No newline at end of file
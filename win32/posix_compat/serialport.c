@@ -1061,6 +1061,29 @@ enum sp_return sp_input_waiting(struct sp_port *port)
 #endif
 }
 
+enum sp_return sp_output_waiting(struct sp_port *port)
+{
+    TRACE("%p", port);
+
+    CHECK_OPEN_PORT();
+
+    DEBUG_FMT("Checking output bytes waiting on port %s", port->name);
+
+#ifdef _WIN32
+    DWORD errors;
+    COMSTAT comstat;
+
+    if (ClearCommError(port->hdl, &errors, &comstat) == 0)
+        RETURN_FAIL("ClearCommError() failed");
+    RETURN_INT(comstat.cbOutQue);
+#else
+    int bytes_waiting;
+    if (ioctl(port->fd, TIOCOUTQ, &bytes_waiting) < 0)
+        RETURN_FAIL("TIOCOUTQ ioctl failed");
+    RETURN_INT(bytes_waiting);
+#endif
+}
+
 enum sp_return sp_new_event_set(struct sp_event_set **result_ptr)
 {
     struct sp_event_set *result;
@@ -2191,6 +2214,50 @@ enum sp_return sp_get_signals(struct sp_port *port,
     RETURN_OK();
 }
 
+enum sp_return sp_set_control_lines(struct sp_port *port, int mask, int asserted)
+{
+    TRACE("%p, 0x%x, 0x%x", port, mask, asserted);
+
+    CHECK_OPEN_PORT();
+
+    DEBUG_FMT("Setting control lines for port %s", port->name);
+
+#ifdef _WIN32
+    if (mask & SP_CTRL_DTR) {
+        if (EscapeCommFunction(port->hdl, (asserted & SP_CTRL_DTR) ? SETDTR : CLRDTR) == 0)
+            RETURN_FAIL("Setting DTR signal level failed");
+    }
+    if (mask & SP_CTRL_RTS) {
+        if (EscapeCommFunction(port->hdl, (asserted & SP_CTRL_RTS) ? SETRTS : CLRRTS) == 0)
+            RETURN_FAIL("Setting RTS signal level failed");
+    }
+#else
+    int set = 0, clear = 0;
+
+    if (mask & SP_CTRL_DTR)
+        *((asserted & SP_CTRL_DTR) ? &set : &clear) |= TIOCM_DTR;
+    if (mask & SP_CTRL_RTS)
+        *((asserted & SP_CTRL_RTS) ? &set : &clear) |= TIOCM_RTS;
+
+    if (set && clear) {
+        /* Lines change in opposite directions, update them at once */
+        int bits;
+        if (ioctl(port->fd, TIOCMGET, &bits) < 0)
+            RETURN_FAIL("TIOCMGET ioctl failed");
+        bits = (bits | set) & ~clear;
+        if (ioctl(port->fd, TIOCMSET, &bits) < 0)
+            RETURN_FAIL("TIOCMSET ioctl failed");
+    } else if (set) {
+        if (ioctl(port->fd, TIOCMBIS, &set) < 0)
+            RETURN_FAIL("TIOCMBIS ioctl failed");
+    } else if (clear) {
+        if (ioctl(port->fd, TIOCMBIC, &clear) < 0)
+            RETURN_FAIL("TIOCMBIC ioctl failed");
+    }
+#endif
+    RETURN_OK();
+}
+
 enum sp_return sp_start_break(struct sp_port *port)
 {
     TRACE("%p", port);
@@ -401,6 +401,14 @@ enum sp_signal {
 	SP_SIG_RI = 8
 };
 
+/** Output control lines. */
+enum sp_control {
+	/** Data terminal ready. */
+	SP_CTRL_DTR = 1,
+	/** Request to send. */
+	SP_CTRL_RTS = 2
+};
+
 /**
  * Transport types.
  *
@@ -1174,6 +1182,17 @@ enum sp_return sp_nonblocking_write(struct sp_port *port, const void *buf, size_
  */
 enum sp_return sp_input_waiting(struct sp_port *port);
 
+/**
+ * Gets the number of bytes waiting in the output buffer.
+ *
+ * @param[in] port Pointer to a port structure. Must not be NULL.
+ *
+ * @return Number of bytes waiting on success, a negative error code otherwise.
+ *
+ * @since 0.1.0
+ */
+enum sp_return sp_output_waiting(struct sp_port *port);
+
 /**
  * Flush serial port buffers. Data in the selected buffer(s) is discarded.
  *
@@ -1301,6 +1320,22 @@ void sp_free_event_set(struct sp_event_set *event_set);
  */
 enum sp_return sp_get_signals(struct sp_port *port, enum sp_signal *signal_mask);
 
+/**
+ * Set the state of the output control lines directly.
+ *
+ * Unlike changing DTR/RTS through a port configuration, this touches the
+ * modem control lines only, so it is fast and lines changed together are
+ * updated in a single call where the platform allows it.
+ *
+ * @param[in] port Pointer to a port structure. Must not be NULL.
+ * @param[in] mask Lines to change, bitwise OR of values of the sp_control enum.
+ * @param[in] asserted Lines of mask to assert, all other lines of mask are
+ *                     deasserted.
+ *
+ * @return SP_OK upon success, a negative error code otherwise.
+ */
+enum sp_return sp_set_control_lines(struct sp_port *port, int mask, int asserted);
+
 /**
  * Put the port transmit line into the break state.
  *
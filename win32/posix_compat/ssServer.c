@@ -304,7 +304,7 @@ static void *Send_Worker(void *ptr)
  * @param Port      Listening port.
  * @param CbEvent   Callback on event.
  * @param CbMsg     Callback on message received.
- * @param TxLen     Maximum send queue length, 0 if unlimited.
+ * @param TxLen     Maximum send queue length, 0 for SS_TX_QUEUE_LENGTH.
  * @param Binary    Binary Mode.
  * @param Blocking  Wait for working threads.
  *
@@ -328,7 +328,12 @@ int SS_Server_Init(SS_Handle_t *hSS, uint32_t Addr, uint16_t Port, SS_EventCb Cb
         pthread_mutex_init(&hSS->Clients[i].Lock, NULL);
     }
 
-    hSS->TxQueue = FIFO_Init(TxLen);
+    hSS->TxQueue = FIFO_Init(TxLen ? TxLen : SS_TX_QUEUE_LENGTH);
+    if(hSS->TxQueue == NULL)
+    {
+        LogEvent(hSS, SS_Event_Error, NULL, "Error: send queue alloc failed.");
+        return -1;
+    }
 
 #ifdef _WIN32
     WSADATA wsaData;
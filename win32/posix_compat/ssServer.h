@@ -32,6 +32,10 @@
 #ifndef SS_ALIVE_TIMEO
 #define SS_ALIVE_TIMEO 300
 #endif
+/* Send queue length when none given */
+#ifndef SS_TX_QUEUE_LENGTH
+#define SS_TX_QUEUE_LENGTH 65535
+#endif
 /* Exported types ------------------------------------------------------------*/
 /* SS event type */
 typedef enum
@@ -84,7 +88,7 @@ struct SS_Handle
  * @param Port      Listening port.
  * @param CbEvent   Callback on event.
  * @param CbMsg     Callback on message received.
- * @param TxLen     Maximum send queue length, 0 if unlimited.
+ * @param TxLen     Maximum send queue length, 0 for SS_TX_QUEUE_LENGTH.
  * @param Binary    Binary Mode.
  * @param Blocking  Wait for working threads.
  *